@@ -3,9 +3,14 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/iotrace.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 int g_buffer_misses = 0, g_buffer_accesses = 0;
 
@@ -16,6 +21,9 @@ struct buffer_entry {
 	uint8_t *buffer;
 	int use_bit;
 	int dirty_bit;
+	unsigned access_cnt; /* Number of times it has been looked up. */
+	block_sector_t owner; /* Inode sector of the file that last wrote it. */
+	unsigned log_seq; /* Journal transaction that last logged it, or 0. */
 	struct lock sector_lock;
 };
 
@@ -28,14 +36,40 @@ int clock_hand;
 /* Lock to add and evict buffer entry. */
 struct lock buffer_cache_lock;
 
-/* Semaphore to indicate the number of occupied buffer entries. */
+/* Semaphore counting the accesses that may still start.  An access
+takes a count before it locks anything and gives it back when it is
+done, so that at least one entry is always left unlocked for
+clock_algorithm_evict.  Nothing is held while waiting for a count, and
+each access that finishes wakes at most one waiting thread. */
 struct semaphore active_sema;
 
-/* Condition variable to indicate there is at least one inactive entry. */
-struct condition inactive_entry;
+static void read_cached(struct block *, block_sector_t, void *, off_t start, off_t end);
+static void read_not_buffered(struct block *, block_sector_t, void *, off_t start, off_t end);
+static void write_cached(struct block *, block_sector_t, void *, off_t start, off_t end, block_sector_t owner, unsigned log_seq, void *image);
+static void write_not_buffered(struct block *, block_sector_t, void *, off_t start, off_t end, block_sector_t owner, unsigned log_seq, void *image);
 
-/* Lock for inactive_entry. */
-struct lock inactive_lock;
+/* Last committed journal transaction.  Entries logged by a later
+transaction are pinned: they must not be written home before the
+journal commits them. */
+static unsigned committed_seq;
+
+/* Sectors queued for the prefetch thread to bring into the cache,
+as a ring of PREFETCH_MAX entries.  Requests that find it full are
+dropped, since they are only hints. */
+#define PREFETCH_MAX 32
+static struct prefetch_request {
+	struct block *block;
+	block_sector_t sector;
+} prefetch_queue[PREFETCH_MAX];
+static int prefetch_head, prefetch_cnt;
+
+/* Lock for the prefetch queue. */
+static struct lock prefetch_lock;
+
+/* Semaphore counting the queued prefetch requests. */
+static struct semaphore prefetch_pending;
+
+static void prefetch_thread (void *aux);
 
 /* A block device. */
 struct block
@@ -51,6 +85,14 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Asynchronous requests, served by an I/O thread started on
+       the first block_submit(). */
+    struct list queue;                  /* Pending block_requests. */
+    struct lock queue_lock;             /* Guards the fields below. */
+    struct condition queue_nonempty;    /* Signaled when QUEUE grows. */
+    bool io_started;                    /* I/O thread started? */
+    block_sector_t head;                /* Sector after the last served. */
   };
 
 /* List of all block devices. */
@@ -60,6 +102,7 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void io_thread (void *block_);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -94,6 +137,7 @@ int acquire_buffer_entry_lock(block_sector_t sector) {
 		if (buffer_cache[i]->buffered_sector == sector) {
 			lock_acquire(&buffer_cache[i]->sector_lock);
 			buffer_cache[i]->use_bit = 1;
+			buffer_cache[i]->access_cnt ++;
 			lock_release(&buffer_cache_lock);
 			return i;
 		}
@@ -139,6 +183,17 @@ bool check_buffer_presence(block_sector_t sector, int offset) {
 	return true;
 }
 
+/* Check if a buffer entry holds changes the journal has not committed yet. */
+static bool buffer_pinned(struct buffer_entry *cur) {
+	return cur->log_seq > committed_seq;
+}
+
+/* Called by the journal once transaction SEQ and all before it are
+on disk, which unpins the entries they logged. */
+void buffer_set_committed_seq(unsigned seq) {
+	committed_seq = seq;
+}
+
 /* Evicts buffer entry from buffer cache. */
 void buffer_evict(int offset) {
   ASSERT (lock_held_by_current_thread(&buffer_cache_lock));
@@ -148,7 +203,9 @@ void buffer_evict(int offset) {
 	ASSERT (lock_held_by_current_thread(&cur->sector_lock));
 
 	if (cur->dirty_bit) {
+		enum iotrace_kind kind = iotrace_set_kind(IOTRACE_META);
   	block_write(cur->sector_block, cur->buffered_sector, cur->buffer);
+		iotrace_set_kind(kind);
 	}
   buffer_cache[offset] = NULL;
 	lock_release(&cur->sector_lock);
@@ -165,11 +222,146 @@ void init_buffer_cache (void) {
   clock_hand = 0;
   lock_init(&buffer_cache_lock);
   sema_init(&active_sema, 64);
-	lock_init(&inactive_lock);
-	cond_init(&inactive_entry);
+	lock_init(&prefetch_lock);
+	sema_init(&prefetch_pending, 0);
+	prefetch_head = prefetch_cnt = 0;
+	thread_create("prefetch", PRI_DEFAULT, prefetch_thread, NULL);
+}
+
+/* Queue SECTOR of BLOCK to be read into the buffer cache in the
+background, so that a read of it soon after finds it cached.
+Returns without waiting for the read. */
+void buffer_prefetch (struct block *block, block_sector_t sector) {
+	lock_acquire(&prefetch_lock);
+	int i;
+	for (i = 0; i < prefetch_cnt; i ++) {
+		if (prefetch_queue[(prefetch_head + i) % PREFETCH_MAX].sector == sector) {
+			lock_release(&prefetch_lock);
+			return;
+		}
+	}
+	if (prefetch_cnt == PREFETCH_MAX) {
+		lock_release(&prefetch_lock);
+		return;
+	}
+	struct prefetch_request *r = &prefetch_queue[(prefetch_head + prefetch_cnt) % PREFETCH_MAX];
+	r->block = block;
+	r->sector = sector;
+	prefetch_cnt ++;
+	lock_release(&prefetch_lock);
+	sema_up(&prefetch_pending);
+}
+
+/* Reads queued sectors into the buffer cache, one at a time. */
+static void prefetch_thread (void *aux UNUSED) {
+	iotrace_set_kind(IOTRACE_INODE); // Directory readahead only prefetches inodes.
+	for (;;) {
+		sema_down(&prefetch_pending);
+		lock_acquire(&prefetch_lock);
+		struct prefetch_request r = prefetch_queue[prefetch_head];
+		prefetch_head = (prefetch_head + 1) % PREFETCH_MAX;
+		prefetch_cnt --;
+		lock_release(&prefetch_lock);
+
+		lock_acquire(&buffer_cache_lock);
+		bool cached = check_sector_cached(r.sector);
+		lock_release(&buffer_cache_lock);
+		if (!cached) {
+			uint8_t byte;
+			read_buffered(r.block, r.sector, &byte, 0, 0); // An empty read just loads the sector.
+		}
+	}
+}
+
+/* Store in SECTORS, which must have room for 64 of them, the sectors
+in the buffer cache, most often looked up first, and return how many
+there are. */
+int buffer_hot_sectors (block_sector_t *sectors) {
+	unsigned counts[64];
+	int cnt = 0;
+	int i, j;
+	lock_acquire(&buffer_cache_lock);
+	for (i = 0; i < 64; i ++) {
+		struct buffer_entry *cur = buffer_cache[i];
+		if (cur == NULL) {
+			continue;
+		}
+		for (j = cnt; j > 0 && counts[j - 1] < cur->access_cnt; j --) { // Insertion sort, hottest first.
+			counts[j] = counts[j - 1];
+			sectors[j] = sectors[j - 1];
+		}
+		counts[j] = cur->access_cnt;
+		sectors[j] = cur->buffered_sector;
+		cnt ++;
+	}
+	lock_release(&buffer_cache_lock);
+	return cnt;
+}
+
+/* Sectors for the prewarm thread to read in, and their number. */
+static block_sector_t *prewarm_sectors;
+static size_t prewarm_cnt;
+
+/* Reads the prewarm sectors into the buffer cache, then exits. */
+static void prewarm_thread (void *block_) {
+	struct block *block = block_;
+	size_t i;
+	iotrace_set_kind(IOTRACE_META);
+	for (i = 0; i < prewarm_cnt; i ++) {
+		lock_acquire(&buffer_cache_lock);
+		bool cached = check_sector_cached(prewarm_sectors[i]);
+		lock_release(&buffer_cache_lock);
+		if (!cached) {
+			uint8_t byte;
+			read_buffered(block, prewarm_sectors[i], &byte, 0, 0);
+		}
+	}
+	free(prewarm_sectors);
+}
+
+/* Read the CNT sectors of BLOCK in SECTORS into the buffer cache in the
+background, in order, to warm it up after mounting.  Returns without
+waiting for them. */
+void buffer_prewarm (struct block *block, const block_sector_t *sectors, size_t cnt) {
+	if (cnt == 0) {
+		return;
+	}
+	prewarm_sectors = malloc(cnt * sizeof *prewarm_sectors);
+	if (prewarm_sectors == NULL) {
+		return; // Only a hint.
+	}
+	memcpy(prewarm_sectors, sectors, cnt * sizeof *prewarm_sectors);
+	prewarm_cnt = cnt;
+	thread_create("prewarm", PRI_DEFAULT, prewarm_thread, block);
 }
 
-/* Flush buffer cache. */
+/* Write back every dirty buffer entry last written on behalf of OWNER,
+without evicting it.  Entries pinned by the journal are skipped.
+Each entry is locked before buffer_cache_lock is dropped, so it can't be
+evicted while it is written back, and other entries stay usable. */
+void flush_buffer_cache_owner (block_sector_t owner) {
+	int i = 0;
+	for (; i < 64; i ++) {
+		lock_acquire(&buffer_cache_lock);
+		struct buffer_entry *cur = buffer_cache[i];
+		if (cur == NULL || cur->owner != owner || buffer_pinned(cur)) {
+			lock_release(&buffer_cache_lock);
+			continue;
+		}
+		lock_acquire(&cur->sector_lock);
+		lock_release(&buffer_cache_lock);
+		if (cur->dirty_bit) {
+			enum iotrace_kind kind = iotrace_set_kind(IOTRACE_META);
+			block_write(cur->sector_block, cur->buffered_sector, cur->buffer);
+			iotrace_set_kind(kind);
+			cur->dirty_bit = 0;
+		}
+		lock_release(&cur->sector_lock);
+	}
+}
+
+/* Flush buffer cache.
+Callers must commit the journal first, since pinned entries are written too. */
 void flush_buffer_cache (void) {
   lock_acquire(&buffer_cache_lock);
   int i = 0;
@@ -182,9 +374,30 @@ void flush_buffer_cache (void) {
   lock_release(&buffer_cache_lock);
 }
 
+/* Drop SECTOR from the buffer cache without writing it back.
+Called when a freed sector is reused for file data, which lives in the
+page cache, so that a stale entry can't later be written over it. */
+void buffer_discard (block_sector_t sector) {
+	lock_acquire(&buffer_cache_lock);
+	int i = 0;
+	for (; i < 64; i ++) {
+		struct buffer_entry *cur = buffer_cache[i];
+		if (cur != NULL && cur->buffered_sector == sector) {
+			lock_acquire(&cur->sector_lock);
+			buffer_cache[i] = NULL;
+			lock_release(&cur->sector_lock);
+			free(cur->buffer);
+			free(cur);
+			break;
+		}
+	}
+	lock_release(&buffer_cache_lock);
+}
+
 /* Evict a buffer entry with clock algorithm.
 The caller needs to make sure that there is at least 1
-empty or inactive buffer entry. */
+empty or inactive buffer entry.  Entries pinned by the journal are passed
+over; the journal keeps few enough of them pinned that one is always found. */
 int clock_algorithm_evict(void) {
 	ASSERT (lock_held_by_current_thread(&buffer_cache_lock));
 	int offset;
@@ -195,7 +408,7 @@ int clock_algorithm_evict(void) {
 			return offset;
 		} else {
 			if (lock_try_acquire(&buffer_cache[clock_hand]->sector_lock) == true) {
-				if (buffer_cache[clock_hand]->use_bit == 1) {
+				if (buffer_cache[clock_hand]->use_bit == 1 || buffer_pinned(buffer_cache[clock_hand])) {
 					buffer_cache[clock_hand]->use_bit = 0;
 					lock_release(&buffer_cache[clock_hand]->sector_lock);
 					clock_hand = (clock_hand + 1) % 64;
@@ -227,74 +440,45 @@ void bounded_write(uint8_t *input_buffer, uint8_t *cache_buffer, off_t start, of
 }
 
 /* Read buffered content from buffer cache.
-If not buffered, call read_not_buffered. */
+If not buffered, the sector is read in first. */
 void read_buffered(struct block * block, block_sector_t sector , void * buffer, off_t start, off_t end) {
+	sema_down(&active_sema);
+	read_cached(block, sector, buffer, start, end);
+	sema_up(&active_sema);
+}
+
+/* Read from the buffer cache.  If not buffered, call read_not_buffered.
+The caller must hold a count of active_sema. */
+static void read_cached(struct block * block, block_sector_t sector , void * buffer, off_t start, off_t end) {
 	int offset = acquire_buffer_entry_lock(sector);
 	if (offset == -1) {
 		return read_not_buffered(block, sector , buffer, start, end);
 	}
-
-	enum intr_level old_level;
-	old_level = intr_disable (); // We disable interrupt because if we can't sema down we need to release the sector_lock atomically.
-	while (!sema_try_down(&active_sema)) {
-		lock_release(&buffer_cache[offset]->sector_lock);
-		intr_set_level (old_level);
-
-		lock_acquire(&inactive_lock);
-		cond_wait(&inactive_entry, &inactive_lock);
-		lock_release(&inactive_lock);
-
-		offset = acquire_buffer_entry_lock(sector); // When we are waiting, the previous buffer entry could be evicted.
-		if (offset == -1 || !check_buffer_presence(sector, offset)) {
-			return read_not_buffered(block, sector , buffer, start, end);
-		}
-
-		old_level = intr_disable ();
-	}
-	intr_set_level (old_level); // We have acquire the lock and performed sema down to mark an active buffer entry.
+	iotrace_record(block, IOTRACE_HIT, iotrace_get_kind(), sector, 1);
 	bounded_read(buffer, buffer_cache[offset]->buffer, start, end);
-
 	lock_release(&buffer_cache[offset]->sector_lock);
-	sema_up(&active_sema);
-	lock_acquire(&inactive_lock);
-	cond_broadcast(&inactive_entry, &inactive_lock); // Signal all waiters that there is at least an inactive entry.
-	lock_release(&inactive_lock);
 }
 
-/* Read from disk, load into buffer cache, and load into buffer. */
-void read_not_buffered(struct block * block , block_sector_t sector , void * buffer, off_t start, off_t end) {
+/* Read from disk, load into buffer cache, and load into buffer.
+The caller must hold a count of active_sema. */
+static void read_not_buffered(struct block * block , block_sector_t sector , void * buffer, off_t start, off_t end) {
 	lock_acquire(&buffer_cache_lock);
 	if (check_sector_cached(sector)) {
 		lock_release(&buffer_cache_lock);
-		return read_buffered(block, sector , buffer, start, end);
-	}
-	enum intr_level old_level;
-	old_level = intr_disable ();
-	while (!sema_try_down(&active_sema)) {
-		lock_release(&buffer_cache_lock);
-
-		intr_set_level (old_level);
-
-		lock_acquire(&inactive_lock);
-		cond_wait(&inactive_entry, &inactive_lock);
-		lock_release(&inactive_lock);
-
-		lock_acquire(&buffer_cache_lock);
-		if (check_sector_cached(sector)) {
-			return read_buffered(block, sector , buffer, start, end);
-		}
-
-		old_level = intr_disable ();
+		return read_cached(block, sector , buffer, start, end);
 	}
-	intr_set_level (old_level);
 	struct buffer_entry *cur = malloc(sizeof(struct buffer_entry));
 	cur->buffered_sector = sector;
 	cur->sector_block = block;
 	cur->use_bit = 1;
 	cur->dirty_bit = 0;
+	cur->access_cnt = 1;
+	cur->owner = BUFFER_NO_OWNER;
+	cur->log_seq = 0;
 	cur->buffer = malloc (BLOCK_SECTOR_SIZE);
 	lock_init(&cur->sector_lock);
 	g_buffer_misses ++;
+	iotrace_record(block, IOTRACE_MISS, iotrace_get_kind(), sector, 1);
 	block_read(block, sector, cur->buffer);
 
 	int offset = clock_algorithm_evict();
@@ -304,97 +488,87 @@ void read_not_buffered(struct block * block , block_sector_t sector , void * buf
 	buffer_cache[offset] = cur;
 
 	lock_release(&buffer_cache_lock);
-	sema_up(&active_sema);
-	lock_acquire(&inactive_lock);
-	cond_broadcast(&inactive_entry, &inactive_lock); // Signal all waiters that there is at least an inactive entry.
-	lock_release(&inactive_lock);
 }
 
 
 /* Write from buffered content to buffer cache.
-If not buffered, call write_not_buffered. */
+The sector is treated as its own owner, which is right for inode sectors. */
 void write_buffered(struct block * block, block_sector_t sector , void * buffer, off_t start, off_t end) {
+	write_buffered_owned(block, sector, buffer, start, end, sector);
+}
+
+/* Write from buffered content to buffer cache on behalf of the inode in
+sector OWNER, so that flush_buffer_cache_owner can find it later. */
+void write_buffered_owned(struct block * block, block_sector_t sector , void * buffer, off_t start, off_t end, block_sector_t owner) {
+	write_buffered_logged(block, sector, buffer, start, end, owner, 0, NULL);
+}
+
+/* Write from buffered content to buffer cache on behalf of OWNER.
+If IMAGE is not null, the write is part of journal transaction LOG_SEQ:
+the entry is pinned until it commits, and the whole updated sector is
+copied to IMAGE while the entry is still locked.
+If not buffered, the sector is read in first. */
+void write_buffered_logged(struct block * block, block_sector_t sector , void * buffer, off_t start, off_t end, block_sector_t owner, unsigned log_seq, void *image) {
+	sema_down(&active_sema);
+	write_cached(block, sector, buffer, start, end, owner, log_seq, image);
+	sema_up(&active_sema);
+}
+
+/* Write to the buffer cache as write_buffered_logged does.  If not
+buffered, call write_not_buffered.
+The caller must hold a count of active_sema. */
+static void write_cached(struct block * block, block_sector_t sector , void * buffer, off_t start, off_t end, block_sector_t owner, unsigned log_seq, void *image) {
 	int offset = acquire_buffer_entry_lock(sector);
 	if (offset == -1) {
-		return write_not_buffered(block, sector , buffer, start, end);
+		return write_not_buffered(block, sector , buffer, start, end, owner, log_seq, image);
 	}
 	struct buffer_entry *cur = buffer_cache[offset];
-	enum intr_level old_level;
-	old_level = intr_disable (); // We disable interrupt because if we can't sema down we need to release the sector_lock atomically.
-	while (!sema_try_down(&active_sema)) {
-		lock_release(&cur->sector_lock);
-		intr_set_level (old_level);
-
-		lock_acquire(&inactive_lock);
-		cond_wait(&inactive_entry, &inactive_lock);
-		lock_release(&inactive_lock);
-
-		offset = acquire_buffer_entry_lock(sector); // When we are waiting, the previous buffer entry could be evicted.
-		if (offset == -1 || !check_buffer_presence(sector, offset)) {
-			return write_not_buffered(block, sector , buffer, start, end);
-		}
-
-		old_level = intr_disable ();
+	iotrace_record(block, IOTRACE_HIT, iotrace_get_kind(), sector, 1);
+	bounded_write(buffer, cur->buffer, start, end);
+	cur->dirty_bit = 1;
+	cur->owner = owner;
+	if (image != NULL) {
+		cur->log_seq = log_seq;
+		memcpy(image, cur->buffer, BLOCK_SECTOR_SIZE);
 	}
-	intr_set_level (old_level); // We have acquire the lock and performed sema down to mark an active buffer entry.
-	bounded_write(buffer, buffer_cache[offset]->buffer, start, end);
-	buffer_cache[offset]->dirty_bit = 1;
-
-	lock_release(&buffer_cache[offset]->sector_lock);
-	sema_up(&active_sema);
-	lock_acquire(&inactive_lock);
-	cond_broadcast(&inactive_entry, &inactive_lock); // Signal all waiters that there is at least an inactive entry.
-	lock_release(&inactive_lock);
+	lock_release(&cur->sector_lock);
 }
 
-/* Read from disk, load into buffer cache, and write from buffer to buffer entry. */
-void write_not_buffered(struct block * block , block_sector_t sector , void * buffer, off_t start, off_t end) {
+/* Read from disk, load into buffer cache, and write from buffer to buffer entry.
+The caller must hold a count of active_sema. */
+static void write_not_buffered(struct block * block , block_sector_t sector , void * buffer, off_t start, off_t end, block_sector_t owner, unsigned log_seq, void *image) {
 	lock_acquire(&buffer_cache_lock);
 	if (check_sector_cached(sector)) {
 		lock_release(&buffer_cache_lock);
-		return write_buffered(block, sector , buffer, start, end);
-	}
-	enum intr_level old_level;
-	old_level = intr_disable ();
-	while (!sema_try_down(&active_sema)) {
-		lock_release(&buffer_cache_lock);
-
-		intr_set_level (old_level);
-
-		lock_acquire(&inactive_lock);
-		cond_wait(&inactive_entry, &inactive_lock);
-		lock_release(&inactive_lock);
-
-		lock_acquire(&buffer_cache_lock);
-		if (check_sector_cached(sector)) {
-			return write_buffered(block, sector , buffer, start, end);
-		}
-
-		old_level = intr_disable ();
+		return write_cached(block, sector , buffer, start, end, owner, log_seq, image);
 	}
-	intr_set_level (old_level);
 	struct buffer_entry *cur = malloc(sizeof(struct buffer_entry));
 	cur->buffered_sector = sector;
 	cur->sector_block = block;
 	cur->use_bit = 1;
 	cur->dirty_bit = 1;
+	cur->access_cnt = 1;
+	cur->owner = owner;
+	cur->log_seq = image != NULL ? log_seq : 0;
 	cur->buffer = malloc (BLOCK_SECTOR_SIZE);
 	lock_init(&cur->sector_lock);
 	g_buffer_misses ++;
-	block_read(block, sector, cur->buffer);
+	iotrace_record(block, IOTRACE_MISS, iotrace_get_kind(), sector, 1);
+	if (start != 0 || end != BLOCK_SECTOR_SIZE) {
+		block_read(block, sector, cur->buffer); // A whole-sector write needn't read the old contents.
+	}
 
 	int offset = clock_algorithm_evict();
 	ASSERT (buffer_cache[offset] == NULL);
 
 	bounded_write(buffer, cur->buffer, start, end);
+	if (image != NULL) {
+		memcpy(image, cur->buffer, BLOCK_SECTOR_SIZE);
+	}
 
 	buffer_cache[offset] = cur;
 
 	lock_release(&buffer_cache_lock);
-	sema_up(&active_sema);
-	lock_acquire(&inactive_lock);
-	cond_broadcast(&inactive_entry, &inactive_lock); // Signal all waiters that there is at least an inactive entry.
-	lock_release(&inactive_lock);
 }
 
 
@@ -471,6 +645,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
+  iotrace_record (block, IOTRACE_READ, iotrace_get_kind (), sector, 1);
   block->ops->read (block->aux, sector, buffer);
   block->read_cnt++;
 }
@@ -485,10 +660,266 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  iotrace_record (block, IOTRACE_WRITE, iotrace_get_kind (), sector, 1);
   block->ops->write (block->aux, sector, buffer);
   block->write_cnt++;
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that can move many sectors with one command do
+   so; for others this is the same as CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, void *buffer)
+{
+  block_sector_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  iotrace_record (block, IOTRACE_READ, iotrace_get_kind (), sector, cnt);
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i,
+                        (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  Drivers that can move many sectors with one command do
+   so; for others this is the same as CNT calls to block_write().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer)
+{
+  block_sector_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  iotrace_record (block, IOTRACE_WRITE, iotrace_get_kind (), sector, cnt);
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i,
+                         (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+  block->write_cnt += cnt;
+}
+
+/* Asynchronous requests.
+
+   Requests submitted with block_submit() wait in a queue per
+   device and are served by that device's I/O thread, one after
+   another.  The thread sweeps across the disk in order of
+   increasing sector and jumps back to the lowest pending sector
+   at the end of each sweep (C-LOOK), so a burst of requests is
+   served in a single pass.  A request that has waited past its
+   deadline is served next regardless, so that a busy region of
+   the disk cannot starve the rest; reads, which usually have
+   someone waiting on them, get much shorter deadlines than
+   writes.  Requests in the same direction for consecutive
+   sectors are merged into one transfer of up to MERGE_MAX
+   sectors. */
+
+/* Ticks a read or a write may wait before it is served ahead of
+   the sweep. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (5 * TIMER_FREQ)
+
+/* Maximum number of sectors in a merged transfer. */
+#define MERGE_MAX 64
+
+/* Queues request R for BLOCK and returns without waiting for it.
+   R's SECTOR, CNT, BUFFER, WRITE, DONE and AUX must be set, and
+   R and BUFFER must stay valid until R->DONE (R) is called from
+   BLOCK's I/O thread, once the transfer is complete.  DONE
+   should not block for long, since no other request is served
+   meanwhile.  Requests that overlap may be served in either
+   order, so the caller must not have a write outstanding to a
+   sector while it reads or writes that sector again. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  ASSERT (r->cnt > 0 && r->done != NULL);
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
+  r->kind = iotrace_get_kind ();
+  lock_acquire (&block->queue_lock);
+  if (!block->io_started)
+    {
+      char name[sizeof block->name + 3];
+
+      snprintf (name, sizeof name, "io-%s", block->name);
+      thread_create (name, PRI_DEFAULT, io_thread, block);
+      block->io_started = true;
+    }
+  list_push_back (&block->queue, &r->elem);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Removes and returns the request in BLOCK's queue to serve
+   next.  The caller must hold BLOCK's queue_lock. */
+static struct block_request *
+next_request (struct block *block)
+{
+  struct block_request *oldest = NULL, *ahead = NULL, *lowest = NULL;
+  struct block_request *r;
+  struct list_elem *e;
+
+  ASSERT (!list_empty (&block->queue));
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      r = list_entry (e, struct block_request, elem);
+      if (oldest == NULL || r->deadline < oldest->deadline)
+        oldest = r;
+      if (r->sector >= block->head
+          && (ahead == NULL || r->sector < ahead->sector))
+        ahead = r;
+      if (lowest == NULL || r->sector < lowest->sector)
+        lowest = r;
+    }
+
+  if (oldest->deadline <= timer_ticks ())
+    r = oldest;
+  else
+    r = ahead != NULL ? ahead : lowest;
+  list_remove (&r->elem);
+  return r;
+}
+
+/* Moves from BLOCK's queue to BATCH, which holds requests for
+   sectors FIRST through *END - 1 in order, every request that
+   extends that run in the same direction as WRITE, up to
+   MERGE_MAX sectors in all.  Updates *END to match.
+   The caller must hold BLOCK's queue_lock. */
+static void
+merge_requests (struct block *block, struct list *batch,
+                block_sector_t *first, block_sector_t *end, bool write)
+{
+  struct list_elem *e;
+
+  e = list_begin (&block->queue);
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      struct list_elem *next = list_next (e);
+
+      if (r->write == write && *end - *first + r->cnt <= MERGE_MAX)
+        {
+          if (r->sector == *end)
+            {
+              list_remove (e);
+              list_push_back (batch, e);
+              *end += r->cnt;
+              e = list_begin (&block->queue);
+              continue;
+            }
+          if (r->sector + r->cnt == *first)
+            {
+              list_remove (e);
+              list_push_front (batch, e);
+              *first = r->sector;
+              e = list_begin (&block->queue);
+              continue;
+            }
+        }
+      e = next;
+    }
+}
+
+/* Serves the requests queued for BLOCK, forever. */
+static void
+io_thread (void *block_)
+{
+  struct block *block = block_;
+  uint8_t *bounce = palloc_get_multiple (PAL_ASSERT,
+                                         MERGE_MAX * BLOCK_SECTOR_SIZE
+                                         / PGSIZE);
+
+  for (;;)
+    {
+      struct block_request *r;
+      struct list batch;
+      block_sector_t first, end;
+      bool write;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      r = next_request (block);
+      list_init (&batch);
+      list_push_back (&batch, &r->elem);
+      first = r->sector;
+      end = r->sector + r->cnt;
+      write = r->write;
+      merge_requests (block, &batch, &first, &end, write);
+      block->head = end;
+      lock_release (&block->queue_lock);
+      iotrace_set_kind (r->kind);
+
+      if (list_size (&batch) == 1)
+        {
+          if (write)
+            block_write_multiple (block, first, end - first, r->buffer);
+          else
+            block_read_multiple (block, first, end - first, r->buffer);
+        }
+      else
+        {
+          /* Gather the merged requests' buffers into one. */
+          struct list_elem *e;
+
+          if (write)
+            {
+              for (e = list_begin (&batch); e != list_end (&batch);
+                   e = list_next (e))
+                {
+                  r = list_entry (e, struct block_request, elem);
+                  memcpy (bounce + (r->sector - first) * BLOCK_SECTOR_SIZE,
+                          r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+                }
+              block_write_multiple (block, first, end - first, bounce);
+            }
+          else
+            {
+              block_read_multiple (block, first, end - first, bounce);
+              for (e = list_begin (&batch); e != list_end (&batch);
+                   e = list_next (e))
+                {
+                  r = list_entry (e, struct block_request, elem);
+                  memcpy (r->buffer,
+                          bounce + (r->sector - first) * BLOCK_SECTOR_SIZE,
+                          r->cnt * BLOCK_SECTOR_SIZE);
+                }
+            }
+        }
+
+      while (!list_empty (&batch))
+        {
+          r = list_entry (list_pop_front (&batch), struct block_request, elem);
+          r->done (r);
+        }
+    }
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -550,6 +981,11 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  list_init (&block->queue);
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  block->io_started = false;
+  block->head = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
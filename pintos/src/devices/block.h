@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 #include <stdbool.h>
 #include "filesys/off_t.h"
 
@@ -44,19 +45,29 @@ enum block_type
 const char *block_type_name (enum block_type);
 
 /* Project 3 Task 1. */
+
+/* Owner of buffer entries that have only been read. */
+#define BUFFER_NO_OWNER ((block_sector_t) -1)
+
 int acquire_buffer_entry_lock(block_sector_t);
 bool check_buffer_presence(block_sector_t, int);
 bool check_sector_cached(block_sector_t);
 void buffer_evict(int);
 void init_buffer_cache (void);
 void flush_buffer_cache (void);
+void flush_buffer_cache_owner (block_sector_t owner);
+void buffer_discard (block_sector_t sector);
+void buffer_prefetch (struct block *, block_sector_t sector);
+int buffer_hot_sectors (block_sector_t *sectors);
+void buffer_prewarm (struct block *, const block_sector_t *sectors, size_t cnt);
 int clock_algorithm_evict(void);
 void bounded_read(uint8_t *input_buffer, uint8_t *cache_buffer, off_t start, off_t end);
 void bounded_write(uint8_t *input_buffer, uint8_t *cache_buffer, off_t start, off_t end);
 void read_buffered(struct block *, block_sector_t, void *, off_t start, off_t end);
-void read_not_buffered(struct block *, block_sector_t, void *, off_t start, off_t end);
 void write_buffered(struct block *, block_sector_t, void *, off_t start, off_t end);
-void write_not_buffered(struct block *, block_sector_t, void *, off_t start, off_t end);
+void write_buffered_owned(struct block *, block_sector_t, void *, off_t start, off_t end, block_sector_t owner);
+void write_buffered_logged(struct block *, block_sector_t, void *, off_t start, off_t end, block_sector_t owner, unsigned log_seq, void *image);
+void buffer_set_committed_seq(unsigned seq);
 
 /* Finding block devices. */
 struct block *block_get_role (enum block_type);
@@ -70,18 +81,44 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* An asynchronous transfer, queued with block_submit(). */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in the device's queue. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* Write, rather than read? */
+    void (*done) (struct block_request *); /* Called once complete. */
+    void *aux;                          /* For DONE's use. */
+    int64_t deadline;                   /* Tick to be served by. */
+    uint8_t kind;                       /* Submitter's trace kind. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* READ_MULTIPLE and WRITE_MULTIPLE may be null, in which case
+   multi-sector transfers are done a sector at a time. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const void *buffer);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -8,7 +8,9 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +32,33 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus-master IDE register port addresses, found through PCI.
+   Each channel has its own set of registers. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer into memory. */
+
+/* Bus-master Status Register bits, cleared by writing 1s. */
+#define BM_STA_ERR 0x02         /* Error. */
+#define BM_STA_INTR 0x04        /* Interrupt. */
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* PCI Command Register bits. */
+#define PCI_CMD_IO 0x01         /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x04     /* Act as a bus master. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +74,17 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors one READ or WRITE command can transfer. */
+#define ATA_MAX_SECTORS 256
+
+/* Most sectors per interrupt we ask for with SET MULTIPLE MODE. */
+#define ATA_MULTIPLE_MAX 16
 
 /* An ATA device. */
 struct ata_disk
@@ -57,7 +93,20 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt for READ and
+                                   WRITE MULTIPLE, 0 if not enabled. */
+    bool dma;                   /* Transfer with bus-master DMA? */
+  };
+
+/* A physical region descriptor, which gives bus-master DMA one
+   physically contiguous piece of a transfer's buffer. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 for 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last descriptor. */
   };
+#define PRD_EOT 0x8000          /* End of table. */
 
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
@@ -72,6 +121,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master registers, 0 if none. */
+    struct prd *prdt;           /* PRD table for bus-master DMA. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,11 +133,16 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, const char *id);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          block_sector_t cnt, const void *, bool writing);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,8 +158,11 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void)
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
+  if (bm_base != 0)
+    printf ("ide: bus-master DMA at port 0x%04"PRIx16"\n", bm_base);
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +186,13 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->bm_base = bm_base + chan_no * 8;
+          c->prdt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+        }
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +203,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +226,61 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* Reads 32-bit register REG of PCI function FUNC of device DEV on
+   bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDRESS, 0x80000000 | dev << 11 | func << 8 | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit register REG of PCI function FUNC of
+   device DEV on bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDRESS, 0x80000000 | dev << 11 | func << 8 | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, like the PIIX that QEMU emulates, enables bus mastering
+   on it and returns the base I/O port of its bus-master
+   registers.  Returns 0 if there is none, in which case all
+   transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4, command;
+
+        if ((pci_read_config (dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 1 (mass storage), subclass 1 (IDE), with the
+           bus-master bit set in the programming interface. */
+        class = pci_read_config (dev, func, 0x08);
+        if (class >> 16 != 0x0101 || (class & 0x8000) == 0)
+          continue;
+        bar4 = pci_read_config (dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* The upper half of the register is status bits that are
+           cleared by writing 1s, so write 0s there. */
+        command = pci_read_config (dev, func, 0x04) & 0xffff;
+        pci_write_config (dev, func, 0x04,
+                          command | PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -303,12 +427,41 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  set_multiple_mode (d, id);
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ MULTIPLE and WRITE MULTIPLE on disk D, whose
+   IDENTIFY DEVICE response is ID, with as many sectors per
+   interrupt as D allows, up to ATA_MULTIPLE_MAX.  Leaves them
+   disabled if D does not support them. */
+static void
+set_multiple_mode (struct ata_disk *d, const char *id)
+{
+  struct channel *c = d->channel;
+  int max = *(const uint16_t *) &id[47 * 2] & 0xff;
+  int cnt = 1;
+
+  /* The count must be a power of 2. */
+  while (cnt * 2 <= max && cnt * 2 <= ATA_MULTIPLE_MAX)
+    cnt *= 2;
+  if (cnt < 2)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -347,12 +500,15 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (!dma_transfer (d, sec_no, 1, buffer, false))
+    {
+      select_sector (d, sec_no, 1);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+      input_sector (c, buffer);
+    }
   lock_release (&c->lock);
 }
 
@@ -367,33 +523,142 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  if (!dma_transfer (d, sec_no, 1, buffer, true))
+    {
+      select_sector (d, sec_no, 1);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+      output_sector (c, buffer);
+      sema_down (&c->completion_wait);
+    }
+  lock_release (&c->lock);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes, with as
+   few commands as possible.  With READ MULTIPLE enabled the disk
+   interrupts once per D->multiple sectors, otherwise once per
+   sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                   void *buffer_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  block_sector_t per_irq = d->multiple > 0 ? d->multiple : 1;
+  uint8_t *buffer = buffer_;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t n = cnt < ATA_MAX_SECTORS ? cnt : ATA_MAX_SECTORS;
+      block_sector_t done, i;
+
+      if (dma_transfer (d, sec_no, n, buffer, false))
+        {
+          buffer += n * BLOCK_SECTOR_SIZE;
+          sec_no += n;
+          cnt -= n;
+          continue;
+        }
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, d->multiple > 0 ? CMD_READ_MULTIPLE
+                                            : CMD_READ_SECTOR_RETRY);
+      for (done = 0; done < n; done += per_irq)
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (i = 0; i < per_irq && done + i < n; i++)
+            {
+              input_sector (c, buffer);
+              buffer += BLOCK_SECTOR_SIZE;
+            }
+        }
+      sec_no += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes, with as few
+   commands as possible.  Returns after the disk has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                    const void *buffer_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  block_sector_t per_irq = d->multiple > 0 ? d->multiple : 1;
+  const uint8_t *buffer = buffer_;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t n = cnt < ATA_MAX_SECTORS ? cnt : ATA_MAX_SECTORS;
+      block_sector_t done, i;
+
+      if (dma_transfer (d, sec_no, n, buffer, true))
+        {
+          buffer += n * BLOCK_SECTOR_SIZE;
+          sec_no += n;
+          cnt -= n;
+          continue;
+        }
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                                            : CMD_WRITE_SECTOR_RETRY);
+      for (done = 0; done < n; done += per_irq)
+        {
+          /* The disk asks for the first group of sectors right
+             away and interrupts to ask for each later one. */
+          if (done > 0)
+            sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (i = 0; i < per_irq && done + i < n; i++)
+            {
+              output_sector (c, buffer);
+              buffer += BLOCK_SECTOR_SIZE;
+            }
+        }
+      sema_down (&c->completion_wait);
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the count CNT, from 1 to ATA_MAX_SECTORS, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= ATA_MAX_SECTORS);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % ATA_MAX_SECTORS);  /* 0 means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -401,8 +666,66 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
         DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
 }
 
+/* Moves CNT sectors, from 1 to ATA_MAX_SECTORS, starting at
+   SEC_NO between disk D and BUFFER with bus-master DMA: from the
+   disk into BUFFER, or from BUFFER to the disk if WRITING.  The
+   calling thread sleeps until the transfer completes.
+   Returns false without doing anything if D can't use DMA or
+   BUFFER is unsuitable, in which case the caller must use PIO.
+   The caller must hold D's channel lock. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              const void *buffer, bool writing)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = writing ? 0 : BM_CMD_READ;
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  struct prd *prd = c->prdt;
+  uintptr_t addr;
+  uint8_t status;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  if (!d->dma || !is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+    return false;
+
+  /* Kernel memory is physically contiguous, so BUFFER only needs
+     splitting where it crosses 64 kB boundaries. */
+  addr = vtop (buffer);
+  for (;;)
+    {
+      size_t chunk = 0x10000 - addr % 0x10000;
+      if (chunk > size)
+        chunk = size;
+      prd->addr = addr;
+      prd->size = chunk % 0x10000;
+      prd->flags = 0;
+      addr += chunk;
+      size -= chunk;
+      if (size == 0)
+        break;
+      prd++;
+    }
+  prd->flags = PRD_EOT;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, writing ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+  status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  if ((status & BM_STA_ERR) != 0 || (inb (reg_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+           d->name, writing ? "write" : "read", sec_no);
+  return true;
+}
+
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt.  Used for DMA commands as well as PIO
+   ones. */
 static void
 issue_pio_command (struct channel *c, uint8_t command)
 {
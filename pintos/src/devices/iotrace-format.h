@@ -0,0 +1,64 @@
+#ifndef DEVICES_IOTRACE_FORMAT_H
+#define DEVICES_IOTRACE_FORMAT_H
+
+/* Format of block I/O trace dumps.
+
+   This header is shared with the host-side utils/iotrace tool,
+   so it must not depend on anything but <stdint.h>.  A dump
+   starts with a struct iotrace_header in the first sector of the
+   scratch device, and the events follow, oldest first, starting
+   in the next sector.  All sectors are 512 bytes. */
+
+#include <stdint.h>
+
+/* What a traced access was for. */
+enum iotrace_kind
+  {
+    IOTRACE_OTHER,                      /* Not classified. */
+    IOTRACE_DATA,                       /* Regular file data. */
+    IOTRACE_INODE,                      /* Inode sectors. */
+    IOTRACE_INDEX,                      /* Index blocks. */
+    IOTRACE_DIR,                        /* Directory contents. */
+    IOTRACE_BITMAP,                     /* Free map contents. */
+    IOTRACE_JOURNAL,                    /* Journal header and log. */
+    IOTRACE_META,                       /* Metadata written back later. */
+    IOTRACE_KIND_CNT
+  };
+
+/* What happened. */
+enum iotrace_op
+  {
+    IOTRACE_READ,                       /* Sectors read from a device. */
+    IOTRACE_WRITE,                      /* Sectors written to a device. */
+    IOTRACE_HIT,                        /* Cache access found the sector. */
+    IOTRACE_MISS,                       /* Cache access brought it in. */
+    IOTRACE_OP_CNT
+  };
+
+/* A traced event. */
+struct iotrace_event
+  {
+    uint32_t ticks;                     /* Timer ticks since boot. */
+    uint32_t sector;                    /* First sector. */
+    int32_t tid;                        /* Thread that made the access. */
+    uint8_t op;                         /* An enum iotrace_op. */
+    uint8_t kind;                       /* An enum iotrace_kind. */
+    uint8_t dev;                        /* Index into DEV_NAMES. */
+    uint8_t cnt;                        /* Number of sectors, up to 255. */
+  };
+
+/* Header of a dump. */
+#define IOTRACE_MAGIC 0x45435254        /* "TRCE" */
+#define IOTRACE_DEVS 16                 /* Maximum devices named. */
+struct iotrace_header
+  {
+    uint32_t magic;                     /* IOTRACE_MAGIC. */
+    uint32_t event_cnt;                 /* Number of events dumped. */
+    uint32_t lost_cnt;                  /* Older events not dumped. */
+    uint32_t timer_freq;                /* Timer ticks per second. */
+    uint32_t dev_cnt;                   /* Number of devices named. */
+    char dev_names[IOTRACE_DEVS][16];   /* Name of each device. */
+    uint8_t unused[512 - 5 * sizeof (uint32_t) - IOTRACE_DEVS * 16];
+  };
+
+#endif /* devices/iotrace-format.h */
@@ -0,0 +1,175 @@
+#include "devices/iotrace.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Block I/O tracing.
+
+   When enabled with the -iotrace option, every sector read from
+   or written to a block device, and every access to the buffer
+   cache or the page cache, is recorded in a ring buffer in
+   memory, the oldest events giving way to new ones once it
+   fills.  At shutdown the ring is dumped to the scratch device,
+   from which utils/iotrace decodes and analyzes it.
+
+   Events are recorded with interrupts off, so any thread may
+   record them cheaply.  With tracing off, recording costs a
+   single test. */
+
+/* Ring of events, or null if tracing is off. */
+static struct iotrace_event *ring;
+static size_t ring_size;                /* Capacity of RING. */
+static uint32_t recorded;               /* Events recorded so far. */
+
+/* Devices seen so far, numbered by their order here. */
+static struct block *devs[IOTRACE_DEVS];
+static size_t dev_cnt;
+
+/* Events per sector of a dump. */
+#define EVENTS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (struct iotrace_event))
+
+/* Starts tracing into a ring of EVENT_CNT events. */
+void
+iotrace_init (size_t event_cnt)
+{
+  size_t page_cnt = DIV_ROUND_UP (event_cnt * sizeof *ring, PGSIZE);
+
+  ASSERT (event_cnt > 0);
+  ring = palloc_get_multiple (0, page_cnt);
+  if (ring == NULL)
+    PANIC ("iotrace: out of memory for %zu events", event_cnt);
+  ring_size = page_cnt * PGSIZE / sizeof *ring;
+  printf ("iotrace: tracing up to %zu events\n", ring_size);
+}
+
+/* Returns the number of device BLOCK in the dump, adding it if
+   necessary.  Devices past IOTRACE_DEVS share the last number.
+   Interrupts must be off. */
+static uint8_t
+dev_number (struct block *block)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  for (i = 0; i < dev_cnt; i++)
+    if (devs[i] == block)
+      return i;
+  if (dev_cnt < IOTRACE_DEVS)
+    devs[dev_cnt++] = block;
+  return dev_cnt - 1;
+}
+
+/* Records that OP happened to CNT sectors of BLOCK starting at
+   SECTOR, for the purpose KIND, if tracing is on. */
+void
+iotrace_record (struct block *block, enum iotrace_op op,
+                enum iotrace_kind kind, block_sector_t sector,
+                block_sector_t cnt)
+{
+  struct iotrace_event *e;
+  enum intr_level old_level;
+
+  if (ring == NULL)
+    return;
+
+  old_level = intr_disable ();
+  e = &ring[recorded++ % ring_size];
+  e->ticks = timer_ticks ();
+  e->sector = sector;
+  e->tid = thread_current ()->tid;
+  e->op = op;
+  e->kind = kind;
+  e->dev = dev_number (block);
+  e->cnt = cnt < 255 ? cnt : 255;
+  intr_set_level (old_level);
+}
+
+/* Returns the running thread's current kind of access. */
+enum iotrace_kind
+iotrace_get_kind (void)
+{
+  return thread_current ()->io_kind;
+}
+
+/* Makes KIND the running thread's current kind of access and
+   returns the previous one, which the caller should restore once
+   it is done. */
+enum iotrace_kind
+iotrace_set_kind (enum iotrace_kind kind)
+{
+  struct thread *t = thread_current ();
+  enum iotrace_kind old = t->io_kind;
+
+  t->io_kind = kind;
+  return old;
+}
+
+/* Stops tracing and writes the trace to the scratch device, as
+   many of the newest events as fit. */
+void
+iotrace_dump (void)
+{
+  static struct iotrace_header header;
+  struct iotrace_event *events = ring;
+  struct block *scratch = block_get_role (BLOCK_SCRATCH);
+  size_t cnt, max_cnt, first, done, i;
+  uint8_t *sector_buf;
+
+  if (events == NULL)
+    return;
+  ring = NULL;
+  if (scratch == NULL)
+    {
+      printf ("iotrace: no scratch device, trace not dumped\n");
+      return;
+    }
+  sector_buf = palloc_get_page (0);
+  if (sector_buf == NULL)
+    {
+      printf ("iotrace: out of memory, trace not dumped\n");
+      return;
+    }
+
+  cnt = recorded < ring_size ? recorded : ring_size;
+  max_cnt = (block_size (scratch) - 1) * EVENTS_PER_SECTOR;
+  if (cnt > max_cnt)
+    cnt = max_cnt;
+  first = recorded - cnt;
+
+  memset (&header, 0, sizeof header);
+  header.magic = IOTRACE_MAGIC;
+  header.event_cnt = cnt;
+  header.lost_cnt = first;
+  header.timer_freq = TIMER_FREQ;
+  header.dev_cnt = dev_cnt;
+  for (i = 0; i < dev_cnt; i++)
+    strlcpy (header.dev_names[i], block_name (devs[i]),
+             sizeof header.dev_names[i]);
+  block_write (scratch, 0, &header);
+
+  /* A page of events at a time, oldest first. */
+  for (done = 0; done < cnt; )
+    {
+      struct iotrace_event *page = (struct iotrace_event *) sector_buf;
+      size_t n = PGSIZE / sizeof *page;
+
+      if (n > cnt - done)
+        n = cnt - done;
+      memset (sector_buf, 0, PGSIZE);
+      for (i = 0; i < n; i++)
+        page[i] = events[(first + done + i) % ring_size];
+      block_write_multiple (scratch, 1 + done / EVENTS_PER_SECTOR,
+                            DIV_ROUND_UP (n, EVENTS_PER_SECTOR), sector_buf);
+      done += n;
+    }
+  palloc_free_page (sector_buf);
+
+  printf ("iotrace: dumped %zu events to %s (%"PRIu32" lost)\n",
+          cnt, block_name (scratch), header.lost_cnt);
+}
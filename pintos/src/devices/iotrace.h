@@ -0,0 +1,19 @@
+#ifndef DEVICES_IOTRACE_H
+#define DEVICES_IOTRACE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+#include "devices/iotrace-format.h"
+
+/* Each thread has a current kind of access, set with
+   iotrace_set_kind() by code that knows what its accesses are
+   for, which is recorded with the device accesses it makes. */
+
+void iotrace_init (size_t event_cnt);
+void iotrace_record (struct block *, enum iotrace_op, enum iotrace_kind,
+                     block_sector_t, block_sector_t cnt);
+enum iotrace_kind iotrace_get_kind (void);
+enum iotrace_kind iotrace_set_kind (enum iotrace_kind);
+void iotrace_dump (void);
+
+#endif /* devices/iotrace.h */
@@ -0,0 +1,130 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory.
+
+   Its contents start out zeroed and are lost at shutdown.  It is
+   registered as a raw device named "rd0", so it only takes on a
+   role when named with an option such as -filesys=rd0 or
+   -scratch=rd0.  With no device latency it shows the CPU cost
+   of the file system by itself, and it makes a fast scratch
+   device.
+
+   The contents are held in separately allocated pages, so a
+   large RAM disk does not need a large contiguous run of
+   memory. */
+
+/* Sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;                    /* Pages holding the contents. */
+  };
+
+static struct ramdisk ramdisk;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of KB kilobytes, rounded up to a whole
+   number of pages, and registers it as block device "rd0".
+   Panics if there is not enough memory for it. */
+void
+ramdisk_init (size_t kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  size_t i;
+
+  ASSERT (page_cnt > 0);
+  ramdisk.pages = malloc (page_cnt * sizeof *ramdisk.pages);
+  if (ramdisk.pages == NULL)
+    PANIC ("rd0: out of memory for %zu kB RAM disk", kb);
+  for (i = 0; i < page_cnt; i++)
+    {
+      ramdisk.pages[i] = palloc_get_page (PAL_ZERO);
+      if (ramdisk.pages[i] == NULL)
+        PANIC ("rd0: out of memory for %zu kB RAM disk", kb);
+    }
+
+  block_register ("rd0", BLOCK_RAW, "RAM disk", page_cnt * PAGE_SECTORS,
+                  &ramdisk_operations, &ramdisk);
+}
+
+/* Returns the address of sector SEC_NO of RD. */
+static uint8_t *
+sector_addr (struct ramdisk *rd, block_sector_t sec_no)
+{
+  return (rd->pages[sec_no / PAGE_SECTORS]
+          + sec_no % PAGE_SECTORS * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads CNT sectors starting at SEC_NO from RD_ into BUFFER_.
+   Sectors are copied a page's worth at a time. */
+static void
+ramdisk_read_multiple (void *rd_, block_sector_t sec_no, block_sector_t cnt,
+                       void *buffer_)
+{
+  struct ramdisk *rd = rd_;
+  uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      block_sector_t n = PAGE_SECTORS - sec_no % PAGE_SECTORS;
+      if (n > cnt)
+        n = cnt;
+      memcpy (buffer, sector_addr (rd, sec_no), n * BLOCK_SECTOR_SIZE);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
+}
+
+/* Writes CNT sectors starting at SEC_NO to RD_ from BUFFER_. */
+static void
+ramdisk_write_multiple (void *rd_, block_sector_t sec_no, block_sector_t cnt,
+                        const void *buffer_)
+{
+  struct ramdisk *rd = rd_;
+  const uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      block_sector_t n = PAGE_SECTORS - sec_no % PAGE_SECTORS;
+      if (n > cnt)
+        n = cnt;
+      memcpy (sector_addr (rd, sec_no), buffer, n * BLOCK_SECTOR_SIZE);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
+}
+
+/* Reads sector SEC_NO from RD_ into BUFFER. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  ramdisk_read_multiple (rd_, sec_no, 1, buffer);
+}
+
+/* Writes sector SEC_NO to RD_ from BUFFER. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  ramdisk_write_multiple (rd_, sec_no, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple
+  };
@@ -11,6 +11,7 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/iotrace.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -92,6 +93,7 @@ shutdown_power_off (void)
 
 #ifdef FILESYS
   filesys_done ();
+  iotrace_dump ();
 #endif
 
   print_stats ();
@@ -0,0 +1,188 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A striped (RAID-0) block device.
+
+   The sectors of device "md0" are dealt out across its member
+   devices a stripe unit at a time: unit 0 goes to the first
+   member, unit 1 to the second, and so on, wrapping around after
+   the last member.  A transfer that spans several units is split
+   into one request per unit, queued on the members all at once,
+   so that members on different IDE channels work in parallel,
+   and units bound for the same member are merged again by its
+   request queue. */
+
+/* Maximum number of members. */
+#define STRIPE_MAX 8
+
+/* A striped device. */
+struct stripe
+  {
+    struct block *members[STRIPE_MAX];  /* Member devices. */
+    size_t member_cnt;                  /* Number of members. */
+    block_sector_t unit;                /* Sectors per stripe unit. */
+  };
+
+static struct stripe stripe;
+
+static struct block_operations stripe_operations;
+
+/* Creates block device "md0", a file system device striped
+   across the devices named in MEMBERS, a comma-separated list,
+   in units of STRIPE_SECTORS sectors.  MEMBERS is modified.
+   Panics if a member does not exist or if there are too many. */
+void
+stripe_init (char *members, unsigned stripe_sectors)
+{
+  block_sector_t member_size = (block_sector_t) -1;
+  char extra_info[64];
+  char *name, *save_ptr;
+  size_t i;
+
+  if (stripe_sectors == 0)
+    PANIC ("md0: stripe unit must be at least one sector");
+  stripe.unit = stripe_sectors;
+  for (name = strtok_r (members, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("md0: no such block device \"%s\"", name);
+      if (stripe.member_cnt >= STRIPE_MAX)
+        PANIC ("md0: more than %d members", STRIPE_MAX);
+      for (i = 0; i < stripe.member_cnt; i++)
+        if (stripe.members[i] == block)
+          PANIC ("md0: %s named twice", name);
+      stripe.members[stripe.member_cnt++] = block;
+      if (block_size (block) < member_size)
+        member_size = block_size (block);
+    }
+  if (stripe.member_cnt == 0)
+    PANIC ("md0: no members");
+
+  /* Every member contributes the same number of whole units. */
+  member_size -= member_size % stripe.unit;
+  if (member_size == 0)
+    PANIC ("md0: members smaller than a stripe unit");
+
+  snprintf (extra_info, sizeof extra_info, "%zu-way stripe of %"PRDSNu
+            "-sector units", stripe.member_cnt, stripe.unit);
+  block_register ("md0", BLOCK_FILESYS, extra_info,
+                  member_size * stripe.member_cnt, &stripe_operations,
+                  &stripe);
+}
+
+/* Finds where sector SEC_NO of S lives.  Returns its member and
+   stores its sector on that member in *MEMBER_SECTOR. */
+static struct block *
+locate (struct stripe *s, block_sector_t sec_no,
+        block_sector_t *member_sector)
+{
+  block_sector_t unit = sec_no / s->unit;
+
+  *member_sector = unit / s->member_cnt * s->unit + sec_no % s->unit;
+  return s->members[unit % s->member_cnt];
+}
+
+/* Completion callback for a piece of a striped transfer. */
+static void
+piece_done (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Reads or writes, according to WRITE, CNT sectors of S starting
+   at SEC_NO from or to BUFFER.  A transfer within a single stripe
+   unit goes straight to its member; longer ones are split. */
+static void
+transfer (struct stripe *s, block_sector_t sec_no, block_sector_t cnt,
+          uint8_t *buffer, bool write)
+{
+  struct block_request *pieces;
+  struct semaphore done;
+  block_sector_t member_sector;
+  struct block *member;
+  size_t piece_cnt, i;
+
+  if (sec_no % s->unit + cnt <= s->unit)
+    {
+      member = locate (s, sec_no, &member_sector);
+      if (write)
+        block_write_multiple (member, member_sector, cnt, buffer);
+      else
+        block_read_multiple (member, member_sector, cnt, buffer);
+      return;
+    }
+
+  piece_cnt = (sec_no % s->unit + cnt + s->unit - 1) / s->unit;
+  pieces = malloc (piece_cnt * sizeof *pieces);
+  if (pieces == NULL)
+    PANIC ("md0: out of memory");
+  sema_init (&done, 0);
+  for (i = 0; i < piece_cnt; i++)
+    {
+      struct block_request *r = &pieces[i];
+      block_sector_t n = s->unit - sec_no % s->unit;
+
+      if (n > cnt)
+        n = cnt;
+      member = locate (s, sec_no, &member_sector);
+      r->sector = member_sector;
+      r->cnt = n;
+      r->buffer = buffer;
+      r->write = write;
+      r->done = piece_done;
+      r->aux = &done;
+      block_submit (member, r);
+
+      sec_no += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+  for (i = 0; i < piece_cnt; i++)
+    sema_down (&done);
+  free (pieces);
+}
+
+/* Reads sector SEC_NO from S into BUFFER. */
+static void
+stripe_read (void *s, block_sector_t sec_no, void *buffer)
+{
+  transfer (s, sec_no, 1, buffer, false);
+}
+
+/* Writes sector SEC_NO to S from BUFFER. */
+static void
+stripe_write (void *s, block_sector_t sec_no, const void *buffer)
+{
+  transfer (s, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SEC_NO from S into BUFFER. */
+static void
+stripe_read_multiple (void *s, block_sector_t sec_no, block_sector_t cnt,
+                      void *buffer)
+{
+  transfer (s, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to S from BUFFER. */
+static void
+stripe_write_multiple (void *s, block_sector_t sec_no, block_sector_t cnt,
+                       const void *buffer)
+{
+  transfer (s, sec_no, cnt, (void *) buffer, true);
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_read,
+    stripe_write,
+    stripe_read_multiple,
+    stripe_write_multiple
+  };
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <list.h>
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
@@ -13,15 +14,12 @@ struct dir
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
+    off_t ahead;                        /* End of entries prefetched. */
   };
 
-/* A single directory entry. */
-struct dir_entry
-  {
-    block_sector_t inode_sector;        /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
-  };
+/* Number of entries past the current position whose inodes the
+   readdir functions prefetch. */
+#define DIR_READAHEAD 8
 
 int g_dir_calloc = 0, g_dir_freed = 0;
 
@@ -46,6 +44,7 @@ dir_open (struct inode *inode)
   ASSERT (dir);
   dir->inode = inode;
   dir->pos = 0;
+  dir->ahead = 0;
   return dir;
 }
 
@@ -128,9 +127,9 @@ lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
   bool result;
-  get_dir_lock (dir_get_inode (dir));
+  get_dir_read_lock (dir_get_inode (dir));
   result = lookup_unsynched (dir, name, ep, ofsp);
-  release_dir_lock (dir_get_inode (dir));
+  release_dir_read_lock (dir_get_inode (dir));
   return result;
 }
 
@@ -170,9 +169,9 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
   bool result;
-  get_dir_lock (dir_get_inode (dir));
+  get_dir_read_lock (dir_get_inode (dir));
   result = dir_lookup_unsynched (dir, name, inode);
-  release_dir_lock (dir_get_inode (dir));
+  release_dir_read_lock (dir_get_inode (dir));
   return result;
 }
 
@@ -263,7 +262,6 @@ dir_remove (struct dir *dir, const char *name)
     release_dir_lock (dir_get_inode (dir));
     return false;
   }
-  release_dir_lock (dir_get_inode (dir));
 
   /* Open inode. */
   inode = inode_open (e.inode_sector);
@@ -271,18 +269,22 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (inode);
   if (inode == NULL)
   {
+    release_dir_lock (dir_get_inode (dir));
     return false;
   }
 
-  /* Erase directory entry. */
+  /* Erase directory entry.  The exclusive lock is held until the
+     entry is gone so concurrent lookups never see it half removed. */
   e.in_use = false;
 
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
   {
     ASSERT (false);
+    release_dir_lock (dir_get_inode (dir));
     inode_remove (inode);
     return false;
   }
+  release_dir_lock (dir_get_inode (dir));
 
   /* Remove inode. */
   inode_remove (inode);
@@ -290,6 +292,28 @@ dir_remove (struct dir *dir, const char *name)
   return true;
 }
 
+/* Queues the inode sectors of the entries in the DIR_READAHEAD
+   slots after DIR's position to be read into the buffer cache in
+   the background, so that opening or examining them once they are
+   listed finds them cached.  Slots queued by an earlier call are
+   skipped.  The caller must hold DIR's read lock. */
+static void
+readahead (struct dir *dir)
+{
+  struct dir_entry e;
+  off_t end = dir->pos + DIR_READAHEAD * sizeof e;
+  off_t ofs = dir->ahead > dir->pos ? dir->ahead : dir->pos;
+
+  for (; ofs < end; ofs += sizeof e)
+    {
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        break;
+      if (e.in_use)
+        buffer_prefetch (fs_device, e.inode_sector);
+    }
+  dir->ahead = ofs;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
@@ -299,18 +323,19 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   struct dir_entry e;
   ASSERT (dir);
   ASSERT (dir->inode);
-  get_dir_lock (dir_get_inode (dir));
+  get_dir_read_lock (dir_get_inode (dir));
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          release_dir_lock (dir_get_inode (dir));
+          readahead (dir);
+          release_dir_read_lock (dir_get_inode (dir));
           return true;
         }
     }
-  release_dir_lock (dir_get_inode (dir));
+  release_dir_read_lock (dir_get_inode (dir));
   return false;
 }
 
@@ -397,14 +422,14 @@ struct inode *get_inode_from_path(char *path) {
     if (cur_dir == NULL) return NULL;
   }
   else cur_dir = dir_open_root();
-  get_dir_lock (dir_get_inode (cur_dir));
+  get_dir_read_lock (dir_get_inode (cur_dir));
   // Iterate through path and find subdirectories.
   int status = 0;
   while (1) {
     status = get_next_part(part, &saved_path);
     // Name length was too long.
     if (status == -1) {
-      release_dir_lock (dir_get_inode (cur_dir));
+      release_dir_read_lock (dir_get_inode (cur_dir));
       dir_close(cur_dir);
       ASSERT (strcmp (path, "..") != 0);
       return NULL;
@@ -412,27 +437,27 @@ struct inode *get_inode_from_path(char *path) {
     // Reached end of path successfully.
     else if (status == 0) {
       if (to_be_removed(dir_get_inode (cur_dir))) {
-        release_dir_lock (dir_get_inode (cur_dir));
+        release_dir_read_lock (dir_get_inode (cur_dir));
         dir_close (cur_dir);
         return NULL;
       }
       struct inode *again = inode_reopen (dir_get_inode (cur_dir));
-      release_dir_lock (dir_get_inode (cur_dir));
+      release_dir_read_lock (dir_get_inode (cur_dir));
       dir_close (cur_dir);
       return again;
     }
     // Got part of the path successfully.
     else {
       if (cur_dir != NULL && dir_lookup_unsynched(cur_dir, part, &next) && !to_be_removed(dir_get_inode(cur_dir))) {
-        release_dir_lock (dir_get_inode (cur_dir));
+        release_dir_read_lock (dir_get_inode (cur_dir));
         dir_close(cur_dir);
         // If next was not a directory, our next iteration will check if cur_dir was set to NULL.
         cur_dir = dir_open(next);
-        get_dir_lock (dir_get_inode (cur_dir));
+        get_dir_read_lock (dir_get_inode (cur_dir));
       }
       // Couldn't find next part of path in directory. Return NULL.
       else {
-        release_dir_lock (dir_get_inode (cur_dir));
+        release_dir_read_lock (dir_get_inode (cur_dir));
         dir_close(cur_dir);
         return NULL;
       }
@@ -485,7 +510,7 @@ bool subdir_create(char *name, struct dir *parent) {
   block_sector_t inode_sector = 0;
   get_dir_lock (dir_get_inode (parent));
   bool success = (parent != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (1, inode_get_inumber (dir_get_inode (parent)), &inode_sector)
                   && dir_create (inode_sector, 2)
                   && dir_add_unsynched (parent, new_name, inode_sector));
 
@@ -523,37 +548,67 @@ bool is_empty(struct dir* dir) {
   size_t ofs;
 
   ASSERT (dir != NULL);
-  get_dir_lock (dir_get_inode (dir));
+  get_dir_read_lock (dir_get_inode (dir));
 
   for (ofs = 0 * (sizeof e); inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
     if (e.in_use && !(strcmp (".", e.name) == 0) && !(strcmp ("..", e.name) == 0))
     {
-      release_dir_lock (dir_get_inode (dir));
+      release_dir_read_lock (dir_get_inode (dir));
       return false;
     }
-  release_dir_lock (dir_get_inode (dir));
+  release_dir_read_lock (dir_get_inode (dir));
   return true;
 }
 
 bool
 dir_readdir_2 (struct dir *dir, char name[NAME_MAX + 1])
 {
-  //lock_acquire
-  get_dir_lock (dir_get_inode (dir));
   struct dir_entry e;
   if (!inode_is (dir->inode)) return false;
+  get_dir_read_lock (dir_get_inode (dir));
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
     {
       dir->pos += sizeof e;
       if (e.in_use && !(strcmp (".", e.name) == 0) && !(strcmp ("..", e.name) == 0))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          release_dir_lock (dir_get_inode (dir));
+          readahead (dir);
+          release_dir_read_lock (dir_get_inode (dir));
           return true;
         }
     }
-  release_dir_lock (dir_get_inode (dir));
+  release_dir_read_lock (dir_get_inode (dir));
+  return false;
+}
+
+/* Like dir_readdir_2, but also reports the entry's inode number in
+   *INUMBER, whether it is a directory in *IS_DIR and its length
+   in *LENGTH.  The metadata is read from the entry's inode sector
+   while DIR is locked, so the inode does not have to be opened
+   and the entry cannot be removed underneath us. */
+bool
+dir_readdir_stat (struct dir *dir, char name[NAME_MAX + 1],
+                  block_sector_t *inumber, bool *is_dir, off_t *length)
+{
+  struct dir_entry e;
+  if (!inode_is (dir->inode)) return false;
+  get_dir_read_lock (dir_get_inode (dir));
+  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+    {
+      dir->pos += sizeof e;
+      if (e.in_use && !(strcmp (".", e.name) == 0) && !(strcmp ("..", e.name) == 0))
+        {
+          strlcpy (name, e.name, NAME_MAX + 1);
+          *inumber = e.inode_sector;
+          *is_dir = inode_get_is_dir (e.inode_sector) == 1;
+          *length = inode_get_length (e.inode_sector);
+          readahead (dir);
+          release_dir_read_lock (dir_get_inode (dir));
+          return true;
+        }
+    }
+  release_dir_read_lock (dir_get_inode (dir));
   return false;
 }
 
@@ -4,12 +4,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
+#include "filesys/ondisk.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
    After directories are implemented, this maximum length may be
    retained, but much longer full path names must be allowed. */
-#define NAME_MAX 14
+#define NAME_MAX DIR_NAME_MAX
 
 /* Max length of a full file path name. */
 #define PATH_MAX 256
@@ -38,6 +40,8 @@ struct dir *get_subdir_from_path(char *);
 bool subdir_create(char *, struct dir *);
 bool is_empty(struct dir*);
 bool dir_readdir_2 (struct dir *dir, char name[NAME_MAX + 1]);
+bool dir_readdir_stat (struct dir *dir, char name[NAME_MAX + 1],
+                       block_sector_t *inumber, bool *is_dir, off_t *length);
 
 
 #endif /* filesys/directory.h */
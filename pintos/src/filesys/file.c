@@ -2,6 +2,8 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 /* An open file. */
 struct file
@@ -115,6 +117,52 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies SIZE bytes starting at offset IN_OFS in IN to offset
+   OUT_OFS in OUT without involving a user buffer, a page at a
+   time through a kernel page.
+   Returns the number of bytes actually copied, which may be less
+   than SIZE if end of IN is reached, or -1 if the two ranges
+   overlap within one file, no page is free, or not everything
+   read could be written, because writes to OUT are denied or the
+   disk is full.  Offsets must not be negative.
+   The files' current positions are unaffected. */
+off_t
+file_copy_range (struct file *in, off_t in_ofs, struct file *out,
+                 off_t out_ofs, off_t size)
+{
+  off_t bytes_copied = 0;
+  uint8_t *page;
+
+  ASSERT (in != NULL && out != NULL);
+  ASSERT (in_ofs >= 0 && out_ofs >= 0 && size >= 0);
+  if (in->inode == out->inode
+      && (in_ofs < out_ofs ? out_ofs - in_ofs : in_ofs - out_ofs) < size)
+    return -1;
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return -1;
+  while (bytes_copied < size)
+    {
+      off_t chunk = size - bytes_copied < PGSIZE ? size - bytes_copied : PGSIZE;
+      off_t bytes_read = inode_read_at (in->inode, page, chunk,
+                                        in_ofs + bytes_copied);
+      off_t bytes_written = inode_write_at (out->inode, page, bytes_read,
+                                            out_ofs + bytes_copied);
+      if (bytes_written < bytes_read)
+        {
+          /* Returning a short count here would look like end of
+             file to a caller copying until it gets 0. */
+          bytes_copied = -1;
+          break;
+        }
+      bytes_copied += bytes_written;
+      if (bytes_read < chunk)
+        break;
+    }
+  palloc_free_page (page);
+  return bytes_copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
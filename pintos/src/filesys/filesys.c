@@ -5,6 +5,8 @@
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/page-cache.h"
 #include "filesys/directory.h"
 #include "threads/thread.h"
 
@@ -12,8 +14,27 @@ int g_filesys_malloc = 0;
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Sectors per file system block.  Chosen by
+   filesys_set_block_size() before formatting, otherwise read back
+   from the journal header. */
+unsigned fs_block_sectors = 1;
+
 static void do_format (void);
 
+/* Makes a file system formatted from now on use blocks of BYTES
+   bytes, which must be a power of 2 from one sector up to
+   FS_BLOCK_SECTORS_MAX sectors. */
+void
+filesys_set_block_size (int bytes)
+{
+  int sectors = bytes / BLOCK_SECTOR_SIZE;
+
+  if (bytes % BLOCK_SECTOR_SIZE != 0 || sectors < 1
+      || sectors > FS_BLOCK_SECTORS_MAX || (sectors & (sectors - 1)) != 0)
+    PANIC ("invalid file system block size %d", bytes);
+  fs_block_sectors = sectors;
+}
+
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
 void
@@ -26,9 +47,17 @@ filesys_init (bool format)
   inode_init ();
   free_map_init ();
   init_buffer_cache();
+  page_cache_init ();
+  journal_init (format);
 
   if (format)
     do_format ();
+  else
+    {
+      /* Read back what was hot at the last clean shutdown. */
+      block_sector_t warm[JOURNAL_WARM_MAX];
+      buffer_prewarm (fs_device, warm, journal_get_warm (warm));
+    }
 
   free_map_open ();
 }
@@ -38,6 +67,11 @@ filesys_init (bool format)
 void
 filesys_done (void)
 {
+  block_sector_t hot[64];
+
+  page_cache_flush_all ();
+  journal_set_warm (hot, buffer_hot_sectors (hot));
+  journal_done ();
   flush_buffer_cache();
   free_map_close ();
 }
@@ -54,7 +88,7 @@ filesys_create (const char *name, off_t initial_size)
   block_sector_t inode_sector = 0;
   struct dir *dir = dir_open_root ();
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (1, ROOT_DIR_SECTOR, &inode_sector)
                   && inode_create (inode_sector, initial_size)
                   && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0)
@@ -128,7 +162,7 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_ENTRIES))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -144,8 +178,10 @@ bool filesys_create_2 (const char *name, off_t initial_size) {
   if (!get_last_part(part, &name)) return false;
   block_sector_t inode_sector = 0;
 
+  /* Keep the inode near its directory, which is read on the way to
+     it, and so its data, which goes right after it. */
   bool success = (subdir != NULL
-                && free_map_allocate (1, &inode_sector)
+                && free_map_allocate_near (1, inode_get_inumber (dir_get_inode (subdir)), &inode_sector)
                 && inode_create (inode_sector, initial_size)
                 && dir_add (subdir, part, inode_sector));
   if (!success && inode_sector != 0) {
@@ -156,6 +192,47 @@ bool filesys_create_2 (const char *name, off_t initial_size) {
   return success;
 }
 
+/* Creates a file named DST that shares the contents of the
+   regular file named SRC until either is written.
+   Returns true if successful, false otherwise.
+   Fails if SRC does not exist or is a directory, if DST already
+   exists, or if the disk fills up. */
+bool
+filesys_clone (const char *src, const char *dst)
+{
+  struct inode *inode = get_inode_from_path ((char *) src);
+  if (inode == NULL)
+    return false;
+  if (inode_is_dir (inode))
+  {
+    inode_close (inode);
+    return false;
+  }
+
+  struct dir *subdir = get_subdir_from_path ((char *) dst);
+  char part[NAME_MAX + 1];
+  block_sector_t inode_sector = 0;
+  bool success = (subdir != NULL
+                  && get_last_part (part, &dst)
+                  && free_map_allocate_near (1, inode_get_inumber (dir_get_inode (subdir)),
+                                             &inode_sector));
+  if (success)
+  {
+    /* Removing a half-made clone drops the references it took. */
+    bool cloned = inode_clone (inode, inode_sector);
+    success = cloned && dir_add (subdir, part, inode_sector);
+    if (!success)
+    {
+      struct inode *clone = inode_open (inode_sector);
+      inode_remove (clone);
+      inode_close (clone);
+    }
+  }
+  dir_close (subdir);
+  inode_close (inode);
+  return success;
+}
+
 struct fd *
 filesys_open_2 (const char *name)
 {
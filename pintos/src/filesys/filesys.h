@@ -3,19 +3,21 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
-
-/* Sectors of system file inodes. */
-#define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
-#define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#include "filesys/ondisk.h"
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
+/* Sectors per file system block. */
+extern unsigned fs_block_sectors;
+
+void filesys_set_block_size (int bytes);
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_clone (const char *src, const char *dst);
 
 /* Project 3 Task 3 */
 bool filesys_create_2 (const char *name, off_t initial_size);
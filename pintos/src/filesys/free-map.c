@@ -1,13 +1,22 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+
+/* Reference counts, one byte per sector, kept in the free map file
+   after the bitmap.  Each byte counts the references to its sector
+   beyond the first, so 0 means a sector has a single owner.  Null
+   if the file system predates reference counts. */
+static uint8_t *refs;
 static struct lock da_lock;
 int sectors = 0;
 
@@ -29,24 +38,41 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
   lock_init (&da_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Only the part of the free map file
+   holding the changed bits is rewritten.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
+{
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate, but takes the first run of CNT free
+   sectors at or after GOAL, wrapping around to the start of the
+   disk if there is none, so that related sectors end up close
+   together. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
 {
   lock();
   sectors += cnt;
   if (sectors % 500 == 0) {}
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  block_sector_t sector = bitmap_scan_and_flip (free_map, goal, cnt, false);
+  if (sector == BITMAP_ERROR && goal != 0)
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+      && !bitmap_write_range (free_map, free_map_file, sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false);
       sector = BITMAP_ERROR;
@@ -58,15 +84,114 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
   return we_are_number_one;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Returns how many separate runs of CNT free sectors the free map
+   holds, which is how many allocations of CNT sectors can succeed
+   if they are packed as tightly as possible. */
+size_t
+free_map_available (size_t cnt)
+{
+  size_t runs = 0;
+
+  ASSERT (cnt > 0);
+  lock ();
+  if (cnt == 1)
+    runs = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  else
+    {
+      size_t start = 0;
+      for (;;)
+        {
+          size_t idx = bitmap_scan (free_map, start, cnt, false);
+          if (idx == BITMAP_ERROR)
+            break;
+          runs++;
+          start = idx + cnt;
+        }
+    }
+  rel ();
+  return runs;
+}
+
+/* Returns the offset of the reference counts in the free map
+   file. */
+static off_t
+refs_ofs (void)
+{
+  return bitmap_file_size (free_map);
+}
+
+/* Writes the reference counts of CNT sectors starting at SECTOR
+   to the free map file. */
+static void
+write_refs (block_sector_t sector, size_t cnt)
+{
+  file_write_at (free_map_file, refs + sector, cnt, refs_ofs () + sector);
+}
+
+/* Drops a reference to each of CNT sectors starting at SECTOR.
+   Sectors left with no references become available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  bool shared = false;
+  size_t i;
+
   ASSERT (bitmap_all (free_map, sector, cnt));
   lock();
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  for (i = 0; i < cnt; i++)
+    if (refs != NULL && refs[sector + i] > 0)
+      {
+        refs[sector + i]--;
+        shared = true;
+      }
+    else
+      bitmap_reset (free_map, sector + i);
+  if (free_map_file != NULL)
+    {
+      bitmap_write_range (free_map, free_map_file, sector, cnt);
+      if (shared)
+        write_refs (sector, cnt);
+    }
+  rel ();
+}
+
+/* Adds a reference to each of CNT sectors starting at SECTOR,
+   which are in use, so that they stay in use until every
+   reference is released.  Returns false, changing nothing, if
+   the file system keeps no reference counts or one of the sectors
+   already has as many references as can be counted. */
+bool
+free_map_ref (block_sector_t sector, size_t cnt)
+{
+  bool success = refs != NULL;
+  size_t i;
+
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  lock ();
+  for (i = 0; success && i < cnt; i++)
+    success = refs[sector + i] < UINT8_MAX;
+  if (success)
+    {
+      for (i = 0; i < cnt; i++)
+        refs[sector + i]++;
+      write_refs (sector, cnt);
+    }
   rel ();
+  return success;
+}
+
+/* Returns true if SECTOR has more than one reference. */
+bool
+free_map_shared (block_sector_t sector)
+{
+  bool shared;
+
+  if (refs == NULL)
+    return false;
+  lock ();
+  shared = refs[sector] > 0;
+  rel ();
+  return shared;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -82,6 +207,17 @@ free_map_open (void)
   {
     PANIC ("can't read free map");
   }
+
+  /* File systems made before reference counts have none, and so
+     can't share sectors. */
+  off_t size = bitmap_size (free_map);
+  if (file_length (free_map_file) >= refs_ofs () + size)
+  {
+    refs = malloc (size);
+    if (refs == NULL
+        || file_read_at (free_map_file, refs, size, refs_ofs ()) != size)
+      PANIC ("can't read reference counts");
+  }
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -89,6 +225,8 @@ void
 free_map_close (void)
 {
   file_close (free_map_file);
+  free (refs);
+  refs = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -96,8 +234,10 @@ free_map_close (void)
 void
 free_map_create (void)
 {
-  /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  /* Create inode, with room for the reference counts, which
+     start out zero. */
+  if (!inode_create (FREE_MAP_SECTOR,
+                     bitmap_file_size (free_map) + bitmap_size (free_map)))
   {
     PANIC ("free map creation failed");
   }
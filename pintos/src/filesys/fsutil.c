@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,19 +68,29 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Sectors fsutil_extract() moves at a time, as many as the block
+   request queue merges into one transfer, and the pages that
+   hold them. */
+#define EXTRACT_BATCH 64
+#define EXTRACT_PAGES DIV_ROUND_UP (EXTRACT_BATCH * BLOCK_SECTOR_SIZE, PGSIZE)
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+   Each file is created at its full size up front, so that its
+   data is allocated in one run, and then filled EXTRACT_BATCH
+   sectors at a time. */
 void
 fsutil_extract (char **argv UNUSED)
 {
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  void *header;
+  uint8_t *data;
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = palloc_get_multiple (0, EXTRACT_PAGES);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -127,10 +138,13 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_BATCH * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_BATCH * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              int chunk_sectors = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+
+              block_read_multiple (src, sector, chunk_sectors, data);
+              sector += chunk_sectors;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -151,7 +165,7 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  palloc_free_multiple (data, EXTRACT_PAGES);
   free (header);
 }
 
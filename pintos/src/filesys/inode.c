@@ -3,34 +3,42 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "devices/iotrace.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/page-cache.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/interrupt.h"
 
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
-
-#define NUM_DIRECT_PTRS 12
-
 int g_inodes_created = 0;
 int g_inodes_freed = 0;
 
 uint8_t zero_block[BLOCK_SECTOR_SIZE] = {0};
 
-/* Returns the number of sectors to allocate for an inode SIZE
+/* File data and index blocks are FS_BLOCK_SIZE bytes, that is
+   fs_block_sectors consecutive sectors, and an index block holds
+   Indirect_Block pointers.  See filesys/ondisk.h. */
+#define FS_BLOCK_SIZE (fs_block_sectors * BLOCK_SECTOR_SIZE)
+#define Indirect_Block ((int) fs_block_sectors * BLOCK_SECTOR_SIZE / 4)
+
+/* Largest number of data blocks a file can have. */
+#define MAX_FILE_BLOCKS \
+  (NUM_DIRECT_PTRS + Indirect_Block * (1 + Indirect_Block))
+
+/* Returns the number of blocks to allocate for an inode SIZE
    bytes long. */
 static inline size_t
-bytes_to_sectors (off_t size)
+bytes_to_blocks (off_t size)
 {
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  return DIV_ROUND_UP (size, FS_BLOCK_SIZE);
 }
 
 static inline size_t
-bytes_to_sector_index (off_t offest)
+bytes_to_block_index (off_t offest)
 {
-  return offest / BLOCK_SECTOR_SIZE;
+  return offest / FS_BLOCK_SIZE;
 }
 
 /* In-memory inode. */
@@ -43,171 +51,252 @@ struct inode
     bool extending;
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     off_t length;
-    struct lock inode_lock;
+    struct rwlock inode_lock;           /* Shared for reads, exclusive otherwise. */
     struct condition until_not_extending;
     struct condition until_no_writers;           /* No longer store Inode content. */
 
     uint32_t magic;
     /* Project 3 Task 3 */
-    struct lock inode_dir_lock;
+    struct rwlock inode_dir_lock;       /* Guards directory entries. */
   };
 
+/* Reads bytes START through END - 1 of the inode in SECTOR into
+   BUFFER. */
+static void
+read_field (block_sector_t sector, void *buffer, off_t start, off_t end)
+{
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_INODE);
+  read_buffered (fs_device, sector, buffer, start, end);
+  iotrace_set_kind (kind);
+}
+
+/* Writes bytes START through END - 1 of the inode in SECTOR from
+   BUFFER. */
+static void
+write_field (block_sector_t sector, void *buffer, off_t start, off_t end)
+{
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_INODE);
+  journal_write (sector, buffer, start, end, sector);
+  iotrace_set_kind (kind);
+}
+
   off_t inode_get_length (block_sector_t sector)
   {
     off_t length;
-    read_buffered (fs_device, sector, &length, 0, sizeof (off_t));
+    read_field (sector, &length, 0, sizeof (off_t));
     return length;
   }
 
   void inode_set_length (block_sector_t sector, off_t length)
   {
-    write_buffered (fs_device, sector, &length, 0, sizeof (off_t));
+    write_field (sector, &length, 0, sizeof (off_t));
   }
 
   uint32_t inode_get_is_dir (block_sector_t sector)
   {
     uint32_t is_dir;
-    read_buffered (fs_device, sector, &is_dir, 4, 4 + sizeof (off_t));
+    read_field (sector, &is_dir, 4, 4 + sizeof (off_t));
     return is_dir;
   }
 
+  /* Returns the length of the inode in SECTOR and stores its
+     directory flag in *IS_DIR, with a single cache access. */
+  off_t inode_get_length_dir (block_sector_t sector, uint32_t *is_dir)
+  {
+    int32_t fields[2];
+    read_field (sector, fields, 0, sizeof fields);
+    *is_dir = fields[1];
+    return fields[0];
+  }
+
   void inode_set_is_dir(block_sector_t sector, uint32_t is_dir)
   {
-    write_buffered (fs_device, sector, &is_dir, 4, 4 + sizeof (off_t));
+    write_field (sector, &is_dir, 4, 4 + sizeof (off_t));
   }
 
   uint32_t inode_get_direct_ptr (block_sector_t sector, int i)
   {
     block_sector_t tar;
-    read_buffered (fs_device, sector, &tar, 8 + 4 * i, 8 + 4 * i + sizeof (block_sector_t));
+    read_field (sector, &tar, 8 + 4 * i, 8 + 4 * i + sizeof (block_sector_t));
     return tar;
   }
 
   void inode_set_direct_ptr(block_sector_t sector, int i, block_sector_t tar)
   {
-    write_buffered (fs_device, sector, &tar, 8 + 4 * i, 8 + 4 * i + sizeof (block_sector_t));
+    write_field (sector, &tar, 8 + 4 * i, 8 + 4 * i + sizeof (block_sector_t));
   }
 
   block_sector_t inode_get_single_ptr (block_sector_t sector)
   {
     block_sector_t tar;
-    read_buffered (fs_device, sector, &tar, 8 + 4 * NUM_DIRECT_PTRS, 8 + 4 * NUM_DIRECT_PTRS + sizeof (block_sector_t));
+    read_field (sector, &tar, 8 + 4 * NUM_DIRECT_PTRS, 8 + 4 * NUM_DIRECT_PTRS + sizeof (block_sector_t));
     return tar;
   }
 
   void inode_set_single_ptr(block_sector_t sector, block_sector_t tar)
   {
-    write_buffered (fs_device, sector, &tar, 8 + 4 * NUM_DIRECT_PTRS, 8 + 4 * NUM_DIRECT_PTRS + sizeof (block_sector_t));
+    write_field (sector, &tar, 8 + 4 * NUM_DIRECT_PTRS, 8 + 4 * NUM_DIRECT_PTRS + sizeof (block_sector_t));
   }
 
   block_sector_t inode_get_double_ptr (block_sector_t sector)
   {
     block_sector_t tar;
-    read_buffered (fs_device, sector, &tar, 8 + 4 * NUM_DIRECT_PTRS + 4, 8 + 4 * NUM_DIRECT_PTRS + 4 + sizeof (block_sector_t));
+    read_field (sector, &tar, 8 + 4 * NUM_DIRECT_PTRS + 4, 8 + 4 * NUM_DIRECT_PTRS + 4 + sizeof (block_sector_t));
     return tar;
   }
 
   void inode_set_double_ptr(block_sector_t sector, block_sector_t tar)
   {
-    write_buffered (fs_device, sector, &tar, 8 + 4 * NUM_DIRECT_PTRS + 4, 8 + 4 * NUM_DIRECT_PTRS + 4 + sizeof (block_sector_t));
+    write_field (sector, &tar, 8 + 4 * NUM_DIRECT_PTRS + 4, 8 + 4 * NUM_DIRECT_PTRS + 4 + sizeof (block_sector_t));
   }
 
   void inode_set_magic(block_sector_t sector, unsigned magic)
   {
-    write_buffered (fs_device, sector, &magic, 8 + 4 * NUM_DIRECT_PTRS + 8, 8 + 4 * NUM_DIRECT_PTRS + 8 + sizeof (unsigned));
+    write_field (sector, &magic, 8 + 4 * NUM_DIRECT_PTRS + 8, 8 + 4 * NUM_DIRECT_PTRS + 8 + sizeof (unsigned));
+  }
+
+  static uint32_t inode_get_inline (block_sector_t sector)
+  {
+    uint32_t is_inline;
+    read_field (sector, &is_inline, INODE_INLINE_FLAG_OFS, INODE_INLINE_FLAG_OFS + sizeof (uint32_t));
+    return is_inline;
+  }
+
+  static void inode_set_inline (block_sector_t sector, uint32_t is_inline)
+  {
+    write_field (sector, &is_inline, INODE_INLINE_FLAG_OFS, INODE_INLINE_FLAG_OFS + sizeof (uint32_t));
   }
 
 
-static bool get_sector (block_sector_t *sector)
+/* Allocates a zeroed block into *SECTOR, as near after GOAL as
+   possible, on behalf of the inode in sector OWNER. */
+static bool get_block (block_sector_t *sector, block_sector_t goal, block_sector_t owner)
 {
-  bool b = free_map_allocate (1, sector);
+  bool b = free_map_allocate_near (fs_block_sectors, goal, sector);
   if (!b) return false;
-  write_buffered (fs_device, *sector, zero_block, 0, BLOCK_SECTOR_SIZE);
+  for (unsigned k = 0; k < fs_block_sectors; k++)
+    write_buffered_owned (fs_device, *sector + k, zero_block, 0, BLOCK_SECTOR_SIZE, owner);
   return true;
 }
 
+/* Returns true if NUM more blocks can be allocated. */
 static bool can_allocate (size_t num)
 {
-  block_sector_t sectors[num];
-  for (size_t i = 0; i < num; i++)
-  {
-    if (!get_sector (&sectors[i]))
-    {
-      for (int j = i - 1; j > 0; j --)
-      {
-        free_map_release (sectors[j], 1);
-      }
-      return false;
-    }
-  }
-  for (int j = num - 1; j > 0; j --)
-  {
-    free_map_release (sectors[j], 1);
-  }
-  return true;
+  return num == 0 || free_map_available (fs_block_sectors) >= num;
 }
 
-static block_sector_t read_sector (block_sector_t sector, int index)
+/* Returns pointer INDEX of the index block starting at SECTOR. */
+static block_sector_t read_ptr (block_sector_t sector, int index)
 {
   ASSERT (sector);
   uint8_t buffer[sizeof(block_sector_t)];
+  sector += index / (BLOCK_SECTOR_SIZE / 4);
+  index %= BLOCK_SECTOR_SIZE / 4;
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_INDEX);
   read_buffered (fs_device, sector, buffer, index * sizeof(int), index * sizeof(int) + sizeof(block_sector_t));
+  iotrace_set_kind (kind);
   return ((block_sector_t*) buffer)[0];
 }
 
-static void write_sector (block_sector_t sector, int index, block_sector_t good_stuff)
+/* Sets pointer INDEX of the index block starting at SECTOR. */
+static void write_ptr (block_sector_t sector, int index, block_sector_t good_stuff, block_sector_t owner)
 {
   ASSERT (sector);
   uint8_t buffer[sizeof(block_sector_t)];
   ((block_sector_t*) buffer)[0] = good_stuff;
-  write_buffered (fs_device, sector, buffer, index * sizeof(int), index * sizeof(int) + sizeof(block_sector_t));
+  sector += index / (BLOCK_SECTOR_SIZE / 4);
+  index %= BLOCK_SECTOR_SIZE / 4;
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_INDEX);
+  journal_write (sector, buffer, index * sizeof(int), index * sizeof(int) + sizeof(block_sector_t), owner);
+  iotrace_set_kind (kind);
 }
 
-#define Indirect_Block (BLOCK_SECTOR_SIZE / 4)
+static void set_block_ptr (block_sector_t sector, int i, block_sector_t sec);
+static block_sector_t get_block_ptr (block_sector_t sector, int i);
+static size_t index_blocks (size_t blocks);
 
-static void install_sector (block_sector_t sector, int i)
+/* Makes the already allocated block starting at SEC data block I
+   of the inode in SECTOR, zeroing it and allocating index blocks
+   as needed.  Metadata is zeroed in the buffer cache and file data
+   in the page cache, which must not find a stale copy of SEC in
+   the other. */
+static void install_block_at (block_sector_t sector, int i, block_sector_t sec)
 {
-  ASSERT (i < NUM_DIRECT_PTRS + BLOCK_SECTOR_SIZE / 4 * (1 + BLOCK_SECTOR_SIZE / 4));
-  block_sector_t sec;
-  ASSERT (get_sector (&sec));
-  write_buffered (fs_device, sec, zero_block, 0, BLOCK_SECTOR_SIZE);
+  ASSERT (i < MAX_FILE_BLOCKS);
+  bool meta = sector == FREE_MAP_SECTOR || inode_get_is_dir (sector);
+  for (unsigned k = 0; k < fs_block_sectors; k++)
+  {
+    journal_revoke (sec + k);
+    if (meta)
+      write_buffered_owned (fs_device, sec + k, zero_block, 0, BLOCK_SECTOR_SIZE, sector);
+    else
+    {
+      buffer_discard (sec + k);
+      page_cache_zero (sector, i * fs_block_sectors + k, sec + k);
+    }
+  }
+  set_block_ptr (sector, i, sec);
+}
+
+/* Points data block I of the inode in SECTOR at the block starting
+   at SEC, allocating index blocks as needed. */
+static void set_block_ptr (block_sector_t sector, int i, block_sector_t sec)
+{
+  ASSERT (i < MAX_FILE_BLOCKS);
   if (i < NUM_DIRECT_PTRS)
   {
     inode_set_direct_ptr(sector, i, sec);
   }
-  else if (i < NUM_DIRECT_PTRS + BLOCK_SECTOR_SIZE / 4)
+  else if (i < NUM_DIRECT_PTRS + Indirect_Block)
   {
     if (inode_get_single_ptr(sector) == 0)
     {
       block_sector_t new_sector;
-      ASSERT (get_sector (&new_sector));
+      ASSERT (get_block (&new_sector, sec, sector));
       inode_set_single_ptr (sector, new_sector);
     }
-    write_sector (inode_get_single_ptr (sector), i - NUM_DIRECT_PTRS, sec);
+    write_ptr (inode_get_single_ptr (sector), i - NUM_DIRECT_PTRS, sec, sector);
   }
   else
   {
     if (inode_get_double_ptr (sector) == 0)
     {
       block_sector_t new_sector;
-      ASSERT (get_sector (&new_sector));
+      ASSERT (get_block (&new_sector, sec, sector));
       inode_set_double_ptr (sector, new_sector);
     }
     int dab = i - NUM_DIRECT_PTRS - Indirect_Block;
     ASSERT (dab >= 0);
-    block_sector_t ind_sec = read_sector (inode_get_double_ptr (sector), dab / Indirect_Block);
+    block_sector_t ind_sec = read_ptr (inode_get_double_ptr (sector), dab / Indirect_Block);
     if (ind_sec == 0)
     {
-      ASSERT (get_sector (&ind_sec));
-      write_sector (inode_get_double_ptr (sector), dab / Indirect_Block, ind_sec);
+      ASSERT (get_block (&ind_sec, sec, sector));
+      write_ptr (inode_get_double_ptr (sector), dab / Indirect_Block, ind_sec, sector);
     }
-    write_sector (ind_sec, dab % Indirect_Block, sec);
+    write_ptr (ind_sec, dab % Indirect_Block, sec, sector);
   }
 }
 
-static bool inode_extend (struct inode *inode, size_t sectors)
+/* Returns where data block I of the inode in SECTOR would best go:
+   right after block I - 1, or right after the inode itself for
+   the first block. */
+static block_sector_t block_goal (block_sector_t sector, int i)
+{
+  block_sector_t prev = i > 0 ? get_block_ptr (sector, i - 1) : 0;
+  return prev != 0 ? prev + fs_block_sectors : sector + 1;
+}
+
+static void install_block (block_sector_t sector, int i)
+{
+  block_sector_t sec;
+  bool success = free_map_allocate_near (fs_block_sectors, block_goal (sector, i), &sec);
+  ASSERT (success);
+  install_block_at (sector, i, sec);
+}
+
+static bool inode_extend (struct inode *inode, size_t blocks)
   {
-    size_t from = bytes_to_sector_index (inode_get_length (inode->sector) - 1);
+    size_t from = bytes_to_block_index (inode_get_length (inode->sector) - 1);
     if (inode_get_length (inode->sector) == 0)
     {
       from = 0;
@@ -216,14 +305,34 @@ static bool inode_extend (struct inode *inode, size_t sectors)
     {
       from ++;
     }
-    if (!can_allocate (sectors)) return false;
-    for (size_t i = from; i < from + sectors; i ++)
+    if (!can_allocate (blocks + index_blocks (from + blocks) - index_blocks (from))) return false;
+    for (size_t i = from; i < from + blocks; i ++)
     {
-      install_sector (inode->sector, i);
+      install_block (inode->sector, i);
     }
     return true;
   }
 
+/* Moves the contents of inline INODE out into a freshly allocated
+   first data block and clears its inline flag, so that it can
+   grow like any other file.  Returns false if no block is free. */
+static bool inode_migrate_inline (struct inode *inode)
+{
+  off_t length = inode_get_length (inode->sector);
+  uint8_t data[INODE_INLINE_MAX];
+
+  if (length > 0 && !can_allocate (1)) return false;
+  if (length > 0)
+    read_buffered (fs_device, inode->sector, data, INODE_INLINE_DATA_OFS, INODE_INLINE_DATA_OFS + length);
+  inode_set_inline (inode->sector, 0);
+  if (length > 0)
+  {
+    install_block (inode->sector, 0);
+    page_cache_write (inode->sector, 0, inode_get_direct_ptr (inode->sector, 0), data, length);
+  }
+  return true;
+}
+
 /*
 This function is called always from inode_write, what this does is it checks if
 the disk_node needs to be extended given its new length and extends accordingly
@@ -231,8 +340,20 @@ if it needs to. :^)
 */
 static bool inode_extend_to_bytes (struct inode *inode, off_t new_length)
 {
-  size_t from = bytes_to_sector_index (inode_get_length (inode->sector) - 1);
-  size_t to = bytes_to_sector_index (new_length - 1);
+  /* A write within the file needs no room, inline or not, so the
+     inline flag is only read when the file grows. */
+  if (new_length <= inode_get_length (inode->sector)) return true;
+  if (inode_get_inline (inode->sector))
+  {
+    if (new_length <= INODE_INLINE_MAX)
+    {
+      inode_set_length (inode->sector, new_length);
+      return true;
+    }
+    if (!inode_migrate_inline (inode)) return false;
+  }
+  size_t from = bytes_to_block_index (inode_get_length (inode->sector) - 1);
+  size_t to = bytes_to_block_index (new_length - 1);
   if (inode_get_length (inode->sector) == 0)
   {
     if (inode_extend (inode, to + 1)) {
@@ -256,48 +377,125 @@ static bool inode_extend_to_bytes (struct inode *inode, off_t new_length)
   return false;
 }
 
-static bool inode_extend_start (block_sector_t sector, size_t sectors)
+static bool inode_extend_start (block_sector_t sector, size_t blocks)
 {
-  for (size_t i = 0; i < sectors; i++)
+  block_sector_t first;
+
+  /* Lay a new file's data out in one run when there is room, so
+     that it can be read and written sequentially. */
+  if (blocks > 1
+      && free_map_allocate_near (blocks * fs_block_sectors, sector + 1, &first))
   {
-    install_sector (sector, i);
+    for (size_t i = 0; i < blocks; i++)
+    {
+      install_block_at (sector, i, first + i * fs_block_sectors);
+    }
+    return true;
+  }
+  for (size_t i = 0; i < blocks; i++)
+  {
+    install_block (sector, i);
   }
   return true;
 }
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Returns the first sector of data block I of the inode in
+   SECTOR.  Returns 0 for a missing direct block, which is how an
+   inline inode looks. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+get_block_ptr (block_sector_t sector, int i)
 {
-  ASSERT (inode != NULL);
-  int i = bytes_to_sector_index (pos);
-  ASSERT (i < NUM_DIRECT_PTRS + BLOCK_SECTOR_SIZE / 4 * (1 + BLOCK_SECTOR_SIZE / 4));
-  if (pos >= inode_get_length (inode->sector)) return -1;
-  ASSERT (pos < inode_get_length (inode->sector));
-  block_sector_t sector;
+  ASSERT (i < MAX_FILE_BLOCKS);
   if (i < NUM_DIRECT_PTRS)
   {
-    sector = inode_get_direct_ptr (inode->sector, i);
+    /* Inline inodes have no data sectors at all. */
+    return inode_get_direct_ptr (sector, i);
   }
   else if (i < NUM_DIRECT_PTRS + Indirect_Block)
   {
-    ASSERT (inode_get_single_ptr (inode->sector));
-    sector = read_sector (inode_get_single_ptr (inode->sector), i - NUM_DIRECT_PTRS);
+    ASSERT (inode_get_single_ptr (sector));
+    block_sector_t block = read_ptr (inode_get_single_ptr (sector), i - NUM_DIRECT_PTRS);
+    ASSERT (block);
+    return block;
   }
   else
   {
-    ASSERT (inode_get_double_ptr (inode->sector));
+    ASSERT (inode_get_double_ptr (sector));
     ASSERT (i >= NUM_DIRECT_PTRS + Indirect_Block);
     block_sector_t dab = i - NUM_DIRECT_PTRS - Indirect_Block;
-    block_sector_t sec_mabel = read_sector (inode_get_double_ptr (inode->sector), dab / Indirect_Block);
+    block_sector_t sec_mabel = read_ptr (inode_get_double_ptr (sector), dab / Indirect_Block);
     ASSERT (sec_mabel);
-    sector = read_sector (sec_mabel, dab % Indirect_Block);
+    block_sector_t block = read_ptr (sec_mabel, dab % Indirect_Block);
+    ASSERT (block);
+    return block;
   }
-  ASSERT (sector);
-  return sector;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE.
+   Returns -1 if INODE does not contain data for a byte at offset
+   POS. */
+static block_sector_t
+byte_to_sector (const struct inode *inode, off_t pos)
+{
+  ASSERT (inode != NULL);
+  if (pos >= inode_get_length (inode->sector)) return -1;
+  ASSERT (pos < inode_get_length (inode->sector));
+  block_sector_t block = get_block_ptr (inode->sector, bytes_to_block_index (pos));
+  if (block == 0)
+    return 0;
+  return block + pos % FS_BLOCK_SIZE / BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the number of index blocks a file of BLOCKS data blocks
+   needs. */
+static size_t
+index_blocks (size_t blocks)
+{
+  size_t n = 0;
+  if (blocks > NUM_DIRECT_PTRS)
+    n++;
+  if (blocks > NUM_DIRECT_PTRS + (size_t) Indirect_Block)
+    n += 1 + DIV_ROUND_UP (blocks - NUM_DIRECT_PTRS - Indirect_Block,
+                           (size_t) Indirect_Block);
+  return n;
+}
+
+/* Gives data block I of INODE, which starts at sector OLD and is
+   shared with other files, a copy of its own, carrying its cached
+   contents over to the new sectors.  Returns the new block's first
+   sector, or 0 if the disk is full. */
+static block_sector_t
+unshare_block (struct inode *inode, int i, block_sector_t old)
+{
+  block_sector_t new;
+
+  if (!free_map_allocate_near (fs_block_sectors, old, &new))
+    return 0;
+  for (unsigned k = 0; k < fs_block_sectors; k++)
+  {
+    journal_revoke (new + k);
+    buffer_discard (new + k);
+    page_cache_move (inode->sector, i * fs_block_sectors + k, old + k, new + k);
+  }
+  set_block_ptr (inode->sector, i, new);
+  free_map_release (old, fs_block_sectors);
+  return new;
+}
+
+/* Makes sure the data block of INODE holding byte offset POS,
+   which is in sector SECTOR, belongs to INODE alone.  Returns the
+   sector now holding POS, or 0 if the disk is full. */
+static block_sector_t
+unshare_sector (struct inode *inode, off_t pos, block_sector_t sector)
+{
+  int k = pos % FS_BLOCK_SIZE / BLOCK_SECTOR_SIZE;
+  block_sector_t block = sector - k;
+
+  if (!free_map_shared (block))
+    return sector;
+  block = unshare_block (inode, bytes_to_block_index (pos), block);
+  return block != 0 ? block + k : 0;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -325,13 +523,17 @@ inode_create_wild (block_sector_t sector, off_t length, bool is_dir)
 
   ASSERT (length >= 0);
 
-  size_t sectors = bytes_to_sectors (length);
-  if (can_allocate (sectors))
+  /* Small regular files keep their data in the inode sector. */
+  bool is_inline = !is_dir && length <= INODE_INLINE_MAX;
+  size_t blocks = is_inline ? 0 : bytes_to_blocks (length);
+  if (can_allocate (blocks + index_blocks (blocks)))
   {
+    journal_write (sector, zero_block, 0, BLOCK_SECTOR_SIZE, sector);
     inode_set_length (sector, length);
     inode_set_is_dir (sector, is_dir);
     inode_set_magic (sector, INODE_MAGIC);
-    success = inode_extend_start (sector, sectors);
+    inode_set_inline (sector, is_inline);
+    success = inode_extend_start (sector, blocks);
     return success;
   }
   return success;
@@ -346,12 +548,25 @@ inode_create (block_sector_t sector, off_t length)
 static void lock (struct inode *inode)
 {
   ASSERT (inode->magic == INODE_MAGIC);
-  lock_acquire (&(inode->inode_lock));
+  rwlock_acquire_write (&(inode->inode_lock));
 }
 
 static void rel (struct inode *inode)
 {
-  lock_release (&(inode->inode_lock));
+  rwlock_release_write (&(inode->inode_lock));
+}
+
+/* Like lock() and rel(), but lets other readers of INODE in at
+   the same time.  Only for paths that do not modify INODE. */
+static void lock_shared (struct inode *inode)
+{
+  ASSERT (inode->magic == INODE_MAGIC);
+  rwlock_acquire_read (&(inode->inode_lock));
+}
+
+static void rel_shared (struct inode *inode)
+{
+  rwlock_release_read (&(inode->inode_lock));
 }
 
 /* Reads an inode from SECTOR
@@ -395,10 +610,10 @@ inode_open (block_sector_t sector)
   inode->deny_write_cnt = 0;
   inode->removed = false;
   inode->magic = INODE_MAGIC;
-  lock_init (&(inode->inode_lock));
+  rwlock_init (&(inode->inode_lock));
 
   /* Project 3 Task 3 */
-  lock_init (&(inode->inode_dir_lock));
+  rwlock_init (&(inode->inode_dir_lock));
 
   g_inodes_created ++;
   return inode;
@@ -445,7 +660,7 @@ inode_close (struct inode *inode)
   {
     return;
   }
-  lock_acquire (&inode->inode_lock);
+  lock (inode);
   bool should_free = false;
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
@@ -455,12 +670,19 @@ inode_close (struct inode *inode)
 
     /* Deallocate blocks if removed. */
     if (inode->removed)
+      page_cache_drop (inode->sector);
+    if (inode->removed && inode_get_inline (inode->sector))
+    {
+      /* Inline inodes own no data sectors. */
+      free_map_release (inode->sector, 1);
+    }
+    else if (inode->removed)
     {
       free_map_release (inode->sector, 1);
       for (int i = 0; i < NUM_DIRECT_PTRS; i ++)
       {
         if (inode_get_direct_ptr (inode->sector, i) == 0) break;
-        free_map_release (inode_get_direct_ptr (inode->sector, i), 1);
+        free_map_release (inode_get_direct_ptr (inode->sector, i), fs_block_sectors);
       }
       bool clear_data (block_sector_t sector, int level)
       {
@@ -468,12 +690,12 @@ inode_close (struct inode *inode)
         if (level == 0){ ASSERT (false);}
         if (level == 1)
         {
-          free_map_release (sector, 1);
+          free_map_release (sector, fs_block_sectors);
           return false;
         }
-        for (int i = 0; i < BLOCK_SECTOR_SIZE / 4; i ++)
+        for (int i = 0; i < Indirect_Block; i ++)
         {
-          if (clear_data (read_sector (sector, i), level - 1))
+          if (clear_data (read_ptr (sector, i), level - 1))
           {
             return true;
           }
@@ -485,7 +707,7 @@ inode_close (struct inode *inode)
     }
     should_free = true;
   }
-  lock_release (&inode->inode_lock);
+  rel (inode);
   if (should_free)
   {
     ASSERT (inode_is(inode));
@@ -513,7 +735,7 @@ inode_remove (struct inode *inode)
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
   ASSERT (inode);
-  lock (inode);
+  lock_shared (inode);
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
   while (size > 0)
@@ -521,9 +743,25 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      if (sector_idx == 0)
+        {
+          /* No data sector: the data is in the inode sector itself.
+             Checking the pointer rather than the inline flag keeps
+             reads of ordinary files at the same cache accesses. */
+          off_t inode_left = inode_length (inode) - offset;
+          off_t chunk_size = size < inode_left ? size : inode_left;
+          read_buffered (fs_device, inode->sector, buffer + bytes_read,
+                         INODE_INLINE_DATA_OFS + offset,
+                         INODE_INLINE_DATA_OFS + offset + chunk_size);
+          bytes_read += chunk_size;
+          break;
+        }
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in inode, bytes left in sector, lesser of the two.
+         The directory flag comes with the length, so telling
+         metadata from file data costs no extra cache access. */
+      uint32_t is_dir;
+      off_t inode_left = inode_get_length_dir (inode->sector, &is_dir) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -532,14 +770,22 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
       if (chunk_size <= 0)
         break;
 
-      read_buffered (fs_device, sector_idx, buffer + bytes_read, sector_ofs, sector_ofs + chunk_size);
+      if (is_dir || inode->sector == FREE_MAP_SECTOR)
+        {
+          enum iotrace_kind kind
+            = iotrace_set_kind (is_dir ? IOTRACE_DIR : IOTRACE_BITMAP);
+          read_buffered (fs_device, sector_idx, buffer + bytes_read, sector_ofs, sector_ofs + chunk_size);
+          iotrace_set_kind (kind);
+        }
+      else
+        page_cache_read (inode->sector, offset, sector_idx, buffer + bytes_read, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  rel (inode);
+  rel_shared (inode);
 
   return bytes_read;
 }
@@ -621,11 +867,28 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     rel (inode);
     return 0;
   }
+  /* Directory contents and the free map are metadata, so they
+     are journaled along with the inodes that describe them. */
+  bool meta = inode->sector == FREE_MAP_SECTOR || inode_get_is_dir (inode->sector);
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      if (sector_idx == 0)
+        {
+          /* No data sector: the file is still small enough to live
+             in the inode sector.  As in inode_read_at(), the pointer
+             tells us so without reading the inline flag. */
+          off_t inode_left = inode_length (inode) - offset;
+          off_t chunk_size = size < inode_left ? size : inode_left;
+          journal_write (inode->sector, (void *) (buffer + bytes_written),
+                         INODE_INLINE_DATA_OFS + offset,
+                         INODE_INLINE_DATA_OFS + offset + chunk_size,
+                         inode->sector);
+          bytes_written += chunk_size;
+          break;
+        }
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
@@ -637,7 +900,23 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      write_buffered (fs_device, sector_idx, buffer + bytes_written, sector_ofs, sector_ofs + chunk_size);
+      if (meta)
+      {
+        enum iotrace_kind kind
+          = iotrace_set_kind (inode->sector == FREE_MAP_SECTOR
+                              ? IOTRACE_BITMAP : IOTRACE_DIR);
+        journal_write (sector_idx, (void *) (buffer + bytes_written), sector_ofs, sector_ofs + chunk_size, inode->sector);
+        iotrace_set_kind (kind);
+      }
+      else
+      {
+        /* A block shared with a clone is copied before it is
+           written. */
+        sector_idx = unshare_sector (inode, offset, sector_idx);
+        if (sector_idx == 0)
+          break;
+        page_cache_write (inode->sector, offset, sector_idx, buffer + bytes_written, chunk_size);
+      }
 
       /* Advance. */
       size -= chunk_size;
@@ -722,6 +1001,161 @@ inode_write_at_no_buffer (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Makes INODE durable, leaving its sectors cached.  Its dirty data
+   pages are written back first, then the journal is committed,
+   which makes its inode sector, index blocks and allocation
+   durable too.  Unless DATA_ONLY, the now committed inode sector
+   and index blocks are also written back in place. */
+void
+inode_sync (struct inode *inode, bool data_only)
+{
+  ASSERT (inode);
+  lock_shared (inode);
+  page_cache_flush (inode->sector);
+  flush_buffer_cache_owner (inode->sector);
+  rel_shared (inode);
+  journal_commit ();
+  if (!data_only)
+    {
+      lock_shared (inode);
+      flush_buffer_cache_owner (inode->sector);
+      rel_shared (inode);
+    }
+}
+
+/* Readies INODE to be mapped into memory, by moving the contents
+   of an inline file out into a data sector of its own.  Returns
+   false if no sector is free. */
+bool
+inode_prepare_map (struct inode *inode)
+{
+  bool success = true;
+
+  ASSERT (inode);
+  lock (inode);
+  if (inode_get_inline (inode->sector))
+    success = inode_migrate_inline (inode);
+  rel (inode);
+  return success;
+}
+
+/* Returns the page cache frame holding the page of INODE at byte
+   offset OFS, which must be page aligned, for mapping into a user
+   address space.  Bytes past the end of the file read as zeros.
+   The frame stays put until inode_unmap_page() is called for it.
+   Returns a null pointer if every cached page is in use. */
+void *
+inode_map_page (struct inode *inode, off_t ofs)
+{
+  block_sector_t sectors[PAGE_SECTORS];
+  off_t length;
+  void *frame;
+  int i;
+
+  ASSERT (inode);
+  lock_shared (inode);
+  length = inode_get_length (inode->sector);
+  for (i = 0; i < PAGE_SECTORS; i++)
+    {
+      off_t pos = ofs + i * BLOCK_SECTOR_SIZE;
+      sectors[i] = pos < length ? byte_to_sector (inode, pos) : 0;
+    }
+  frame = page_cache_map (inode->sector, ofs, sectors);
+  rel_shared (inode);
+  return frame;
+}
+
+/* Releases the frame returned by inode_map_page() for INODE and
+   OFS.  If DIRTY, the mapping wrote to it, so any of its blocks
+   shared with a clone are copied first, keeping the clone as it
+   was. */
+void
+inode_unmap_page (struct inode *inode, off_t ofs, bool dirty)
+{
+  ASSERT (inode);
+  if (dirty)
+  {
+    lock (inode);
+    off_t length = inode_get_length (inode->sector);
+    for (off_t pos = ofs; pos < ofs + PGSIZE && pos < length; pos += FS_BLOCK_SIZE)
+      unshare_sector (inode, pos, byte_to_sector (inode, pos));
+    rel (inode);
+  }
+  page_cache_unmap (inode->sector, ofs, dirty);
+}
+
+/* Marks the pages of INODE, which is LENGTH bytes long, that are
+   mapped into user address spaces dirty, since their mappings may
+   have written to them without the page cache knowing.  As in
+   inode_unmap_page(), their blocks get sectors of their own first.
+   Returns false if the disk is full.  The caller must hold
+   INODE's lock. */
+static bool
+dirty_mapped_pages (struct inode *inode, off_t length)
+{
+  for (off_t ofs = 0; ofs < length; ofs += PGSIZE)
+  {
+    if (!page_cache_is_mapped (inode->sector, ofs))
+      continue;
+    for (off_t pos = ofs; pos < ofs + PGSIZE && pos < length; pos += FS_BLOCK_SIZE)
+      if (unshare_sector (inode, pos, byte_to_sector (inode, pos)) == 0)
+        return false;
+    page_cache_dirty_mapped (inode->sector, ofs);
+  }
+  return true;
+}
+
+/* Writes a new inode to SECTOR that shares the contents of SRC, a
+   regular file, until either of them is written.  Data blocks are
+   shared, each gaining a reference; index blocks are copied.
+   Returns false if the disk is full or a block has as many
+   references as can be counted, leaving an inode in SECTOR that
+   holds the blocks shared so far, for the caller to remove. */
+bool
+inode_clone (struct inode *src, block_sector_t sector)
+{
+  bool success = true;
+
+  ASSERT (src);
+  lock (src);
+  off_t length = inode_get_length (src->sector);
+  uint32_t is_inline = inode_get_inline (src->sector);
+
+  /* The shared sectors must hold SRC's current data, including
+     what its mappings wrote. */
+  success = dirty_mapped_pages (src, length);
+  page_cache_flush (src->sector);
+
+  journal_write (sector, zero_block, 0, BLOCK_SECTOR_SIZE, sector);
+  inode_set_is_dir (sector, 0);
+  inode_set_magic (sector, INODE_MAGIC);
+  inode_set_inline (sector, is_inline);
+  if (is_inline)
+  {
+    uint8_t data[INODE_INLINE_MAX];
+    if (length > 0)
+    {
+      read_buffered (fs_device, src->sector, data, INODE_INLINE_DATA_OFS, INODE_INLINE_DATA_OFS + length);
+      journal_write (sector, data, INODE_INLINE_DATA_OFS, INODE_INLINE_DATA_OFS + length, sector);
+    }
+  }
+  else
+  {
+    size_t blocks = bytes_to_blocks (length);
+    success = success && can_allocate (index_blocks (blocks));
+    for (size_t i = 0; success && i < blocks; i++)
+    {
+      block_sector_t block = get_block_ptr (src->sector, i);
+      success = free_map_ref (block, fs_block_sectors);
+      if (success)
+        set_block_ptr (sector, i, block);
+    }
+  }
+  inode_set_length (sector, success ? length : 0);
+  rel (src);
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -761,28 +1195,38 @@ inode_length (const struct inode *inode)
 bool inode_is_dir(const struct inode *inode) {
   ASSERT (inode != NULL);
   if (inode == NULL) return false;
-  lock (inode);
+  lock_shared (inode);
   if (inode_get_is_dir (inode->sector) == 1)
   {
-    rel (inode);
+    rel_shared (inode);
     return true;
   }
-  rel (inode);
+  rel_shared (inode);
   return false;
 }
 
+/* Takes INODE's directory lock exclusively, for adding or
+   removing entries. */
 void get_dir_lock(const struct inode *inode) {
   ASSERT (inode != NULL);
-  lock (inode);
-  lock_acquire(&(inode->inode_dir_lock));
-  rel (inode);
+  rwlock_acquire_write(&(inode->inode_dir_lock));
 }
 
 void release_dir_lock(const struct inode *inode) {
   ASSERT (inode != NULL);
-  lock (inode);
-  lock_release(&(inode->inode_dir_lock));
-  rel (inode);
+  rwlock_release_write(&(inode->inode_dir_lock));
+}
+
+/* Takes INODE's directory lock shared, for lookups and listing.
+   Any number of threads may search a directory at once. */
+void get_dir_read_lock(const struct inode *inode) {
+  ASSERT (inode != NULL);
+  rwlock_acquire_read(&(inode->inode_dir_lock));
+}
+
+void release_dir_read_lock(const struct inode *inode) {
+  ASSERT (inode != NULL);
+  rwlock_release_read(&(inode->inode_dir_lock));
 }
 
 void inode_set_dir(struct inode *inode) {
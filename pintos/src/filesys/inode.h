@@ -19,6 +19,11 @@ off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_read_at_no_buffer (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 off_t inode_write_at_no_buffer (struct inode *, const void *, off_t size, off_t offset);
+void inode_sync (struct inode *, bool data_only);
+bool inode_prepare_map (struct inode *);
+void *inode_map_page (struct inode *, off_t ofs);
+void inode_unmap_page (struct inode *, off_t ofs, bool dirty);
+bool inode_clone (struct inode *, block_sector_t);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -27,11 +32,15 @@ off_t inode_length (const struct inode *);
 bool inode_is_dir(const struct inode *);
 void get_dir_lock(const struct inode *);
 void release_dir_lock(const struct inode *);
+void get_dir_read_lock(const struct inode *);
+void release_dir_read_lock(const struct inode *);
 void inode_set_dir(struct inode *);
 block_sector_t *get_inode_sector(const struct inode*);
 uint32_t o_inumber (struct inode *); //Proj 3 added
 bool to_be_removed (struct inode *);
 bool inode_is (struct inode* inode);
 int inode_cnt (struct inode* inode);
+off_t inode_get_length (block_sector_t sector);
+uint32_t inode_get_is_dir (block_sector_t sector);
 
 #endif /* filesys/inode.h */
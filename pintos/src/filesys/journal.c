@@ -0,0 +1,448 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/iotrace.h"
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata write-ahead journal.
+
+   Every write to a metadata sector (inode sectors, index blocks,
+   directory contents and the free map) goes through
+   journal_write().  The write lands in the buffer cache as usual,
+   and a copy of the whole sector is kept with the running
+   transaction.  The cache entry is pinned until that transaction
+   is committed, so the sector never reaches its home location
+   ahead of the log.
+
+   Committing writes a descriptor naming the sectors, their
+   images and a commit record to the log with sequential writes.
+   Committed images stay in memory until a checkpoint writes them
+   home, which happens when the log fills up and at shutdown.
+   Transactions are committed by a background thread about once a
+   second, by fsync, and whenever one grows large, so many
+   operations share one log write.
+
+   Transactions are committed in order and capture every metadata
+   write in order, so after a crash recovery replays a prefix of
+   the metadata history. */
+
+/* A transaction is committed as soon as it holds TXN_SOFT
+   sectors, and writers wait for a commit rather than let it grow
+   past TXN_HARD.  Uncommitted sectors are pinned in the buffer
+   cache, so both stay well below its 64 entries. */
+#define TXN_SOFT 16
+#define TXN_HARD 24
+
+/* Ticks a metadata change may wait before it is committed. */
+#define COMMIT_TICKS TIMER_FREQ
+
+/* In-memory image of a logged sector. */
+struct journal_image
+  {
+    struct list_elem elem;              /* Element in a transaction. */
+    block_sector_t sector;              /* Home sector. */
+    struct block_request req;           /* Checkpoint write. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+/* Held shared by writers and exclusively to close the running
+   transaction. */
+static struct rwlock txn_lock;
+
+/* Running transaction, guarded by running_lock. */
+static struct lock running_lock;
+static struct list running;             /* List of journal_image. */
+static size_t running_cnt;              /* Length of RUNNING. */
+static unsigned running_seq;            /* Sequence number of RUNNING. */
+
+/* Serializes commits and checkpoints, and guards the fields
+   below. */
+static struct lock commit_lock;
+static struct list checkpoint_list;     /* Committed, not yet home. */
+static size_t log_used;                 /* Log sectors in use. */
+static struct journal_block log_block;  /* Scratch sector. */
+
+/* Upped when the running transaction gets its first sector. */
+static struct semaphore pending;
+
+/* Hot sectors recorded in the journal header. */
+static block_sector_t warm[JOURNAL_WARM_MAX];
+static size_t warm_cnt;
+
+static void journal_thread (void *aux);
+static unsigned journal_replay (unsigned seq);
+static void write_header (unsigned seq);
+static void checkpoint (unsigned seq);
+
+/* Returns the device sector of log sector POS. */
+static inline block_sector_t
+log_sector (size_t pos)
+{
+  return JOURNAL_SECTOR + 1 + pos;
+}
+
+/* Returns the image of SECTOR in LIST, or a null pointer. */
+static struct journal_image *
+find_image (struct list *list, block_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (list); e != list_end (list); e = list_next (e))
+    {
+      struct journal_image *image = list_entry (e, struct journal_image,
+                                                elem);
+      if (image->sector == sector)
+        return image;
+    }
+  return NULL;
+}
+
+/* Initializes the journal.  If FORMAT is true, starts an empty
+   journal; otherwise replays any committed transactions left in
+   the log by an unclean shutdown. */
+void
+journal_init (bool format)
+{
+  unsigned seq = 1;
+
+  rwlock_init (&txn_lock);
+  lock_init (&running_lock);
+  lock_init (&commit_lock);
+  list_init (&running);
+  list_init (&checkpoint_list);
+  sema_init (&pending, 0);
+
+  if (!format)
+    {
+      block_read (fs_device, JOURNAL_SECTOR, &log_block);
+      if (log_block.magic != JOURNAL_MAGIC)
+        PANIC ("file system has no journal, reformat it");
+      fs_block_sectors = log_block.block_sectors != 0
+                         ? log_block.block_sectors : 1;
+      if (fs_block_sectors > FS_BLOCK_SECTORS_MAX
+          || (fs_block_sectors & (fs_block_sectors - 1)) != 0)
+        PANIC ("file system has bad block size %u", fs_block_sectors);
+      warm_cnt = log_block.cnt <= JOURNAL_WARM_MAX ? log_block.cnt : 0;
+      memcpy (warm, log_block.sectors, warm_cnt * sizeof *warm);
+      seq = journal_replay (log_block.seq);
+    }
+  write_header (seq);
+  log_used = 0;
+  running_cnt = 0;
+  running_seq = seq;
+  buffer_set_committed_seq (seq - 1);
+
+  thread_create ("journal", PRI_DEFAULT, journal_thread, NULL);
+}
+
+/* Commits the running transaction and writes every committed
+   sector home, leaving the log empty. */
+void
+journal_done (void)
+{
+  journal_commit ();
+  lock_acquire (&commit_lock);
+  checkpoint (running_seq);
+  lock_release (&commit_lock);
+}
+
+/* Writes bytes START through END - 1 of SECTOR from BUFFER into
+   the buffer cache on behalf of the inode in sector OWNER, as part
+   of the running transaction. */
+void
+journal_write (block_sector_t sector, void *buffer,
+               off_t start, off_t end, block_sector_t owner)
+{
+  struct journal_image *spare = NULL;
+  struct journal_image *image;
+  bool full;
+
+  for (;;)
+    {
+      rwlock_acquire_read (&txn_lock);
+      lock_acquire (&running_lock);
+      image = find_image (&running, sector);
+      full = running_cnt >= TXN_HARD;
+      if (image == NULL && spare != NULL && !full)
+        {
+          image = spare;
+          spare = NULL;
+          image->sector = sector;
+          list_push_back (&running, &image->elem);
+          if (running_cnt++ == 0)
+            sema_up (&pending);
+        }
+      lock_release (&running_lock);
+      if (image != NULL)
+        break;
+      rwlock_release_read (&txn_lock);
+
+      if (full)
+        journal_commit ();
+      else
+        {
+          spare = malloc (sizeof *spare);
+          if (spare == NULL)
+            PANIC ("out of memory for journal");
+        }
+    }
+
+  write_buffered_logged (fs_device, sector, buffer, start, end, owner,
+                         running_seq, image->data);
+  full = running_cnt >= TXN_SOFT;
+  rwlock_release_read (&txn_lock);
+
+  free (spare);
+  if (full)
+    journal_commit ();
+}
+
+/* Writes the running transaction to the log.  Returns once it is
+   on disk. */
+void
+journal_commit (void)
+{
+  enum iotrace_kind kind;
+  struct list txn;
+  struct list_elem *e;
+  size_t cnt, i;
+  unsigned seq;
+
+  lock_acquire (&commit_lock);
+
+  /* Close the running transaction and start the next one. */
+  rwlock_acquire_write (&txn_lock);
+  list_init (&txn);
+  while (!list_empty (&running))
+    list_push_back (&txn, list_pop_front (&running));
+  cnt = running_cnt;
+  seq = running_seq;
+  if (cnt > 0)
+    running_seq++;
+  running_cnt = 0;
+  rwlock_release_write (&txn_lock);
+
+  if (cnt == 0)
+    {
+      lock_release (&commit_lock);
+      return;
+    }
+
+  if (log_used + cnt + 2 > JOURNAL_LOG_SECTORS)
+    checkpoint (seq);
+
+  /* Descriptor, images, then commit record. */
+  kind = iotrace_set_kind (IOTRACE_JOURNAL);
+  memset (&log_block, 0, sizeof log_block);
+  log_block.magic = JOURNAL_DESC_MAGIC;
+  log_block.seq = seq;
+  log_block.cnt = cnt;
+  i = 0;
+  for (e = list_begin (&txn); e != list_end (&txn); e = list_next (e))
+    log_block.sectors[i++] = list_entry (e, struct journal_image,
+                                         elem)->sector;
+  block_write (fs_device, log_sector (log_used), &log_block);
+  i = 0;
+  for (e = list_begin (&txn); e != list_end (&txn); e = list_next (e))
+    block_write (fs_device, log_sector (log_used + 1 + i++),
+                 list_entry (e, struct journal_image, elem)->data);
+  log_block.magic = JOURNAL_COMMIT_MAGIC;
+  block_write (fs_device, log_sector (log_used + 1 + cnt), &log_block);
+  iotrace_set_kind (kind);
+  log_used += cnt + 2;
+
+  /* The cache may now write these sectors home. */
+  buffer_set_committed_seq (seq);
+
+  /* Keep only the newest committed image of each sector. */
+  while (!list_empty (&txn))
+    {
+      struct journal_image *image
+        = list_entry (list_pop_front (&txn), struct journal_image, elem);
+      struct journal_image *old = find_image (&checkpoint_list,
+                                              image->sector);
+      if (old != NULL)
+        {
+          list_remove (&old->elem);
+          free (old);
+        }
+      list_push_back (&checkpoint_list, &image->elem);
+    }
+
+  lock_release (&commit_lock);
+}
+
+/* Called when SECTOR is allocated to hold file data.  A logged
+   image of its old metadata contents must not be written over the
+   data later, so if there is one, everything logged so far is
+   committed and written home. */
+void
+journal_revoke (block_sector_t sector)
+{
+  bool logged;
+
+  lock_acquire (&running_lock);
+  logged = find_image (&running, sector) != NULL;
+  lock_release (&running_lock);
+  lock_acquire (&commit_lock);
+  logged = logged || find_image (&checkpoint_list, sector) != NULL;
+  lock_release (&commit_lock);
+
+  if (logged)
+    journal_done ();
+}
+
+/* Stores the hot sectors recorded in the journal header in
+   SECTORS, which must have room for JOURNAL_WARM_MAX of them, and
+   returns how many there are. */
+size_t
+journal_get_warm (block_sector_t *sectors)
+{
+  memcpy (sectors, warm, warm_cnt * sizeof *warm);
+  return warm_cnt;
+}
+
+/* Records the CNT hot sectors in SECTORS, hottest first, to be
+   written with the journal header from now on.  Only the first
+   JOURNAL_WARM_MAX are kept. */
+void
+journal_set_warm (const block_sector_t *sectors, size_t cnt)
+{
+  lock_acquire (&commit_lock);
+  warm_cnt = cnt < JOURNAL_WARM_MAX ? cnt : JOURNAL_WARM_MAX;
+  memcpy (warm, sectors, warm_cnt * sizeof *warm);
+  lock_release (&commit_lock);
+}
+
+/* Commits the running transaction about once a second while it
+   has anything in it. */
+static void
+journal_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&pending);
+      timer_sleep (COMMIT_TICKS);
+      journal_commit ();
+    }
+}
+
+/* Replays the committed transactions in the log, the first of
+   which has sequence number SEQ.  Returns the sequence number
+   following the last one replayed. */
+static unsigned
+journal_replay (unsigned seq)
+{
+  uint8_t *data = malloc (BLOCK_SECTOR_SIZE);
+  block_sector_t sectors[TXN_HARD];
+  size_t pos = 0;
+  int txns = 0;
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_JOURNAL);
+
+  if (data == NULL)
+    PANIC ("out of memory for journal");
+  while (pos + 2 <= JOURNAL_LOG_SECTORS)
+    {
+      size_t cnt, i;
+
+      block_read (fs_device, log_sector (pos), &log_block);
+      cnt = log_block.cnt;
+      if (log_block.magic != JOURNAL_DESC_MAGIC || log_block.seq != seq
+          || cnt == 0 || cnt > TXN_HARD
+          || pos + cnt + 2 > JOURNAL_LOG_SECTORS)
+        break;
+      memcpy (sectors, log_block.sectors, cnt * sizeof *sectors);
+
+      block_read (fs_device, log_sector (pos + 1 + cnt), &log_block);
+      if (log_block.magic != JOURNAL_COMMIT_MAGIC || log_block.seq != seq)
+        break;
+
+      for (i = 0; i < cnt; i++)
+        {
+          block_read (fs_device, log_sector (pos + 1 + i), data);
+          iotrace_set_kind (IOTRACE_META);
+          block_write (fs_device, sectors[i], data);
+          iotrace_set_kind (IOTRACE_JOURNAL);
+        }
+      pos += cnt + 2;
+      seq++;
+      txns++;
+    }
+  free (data);
+  iotrace_set_kind (kind);
+
+  if (txns > 0)
+    printf ("journal: replayed %d transactions\n", txns);
+  return seq;
+}
+
+/* Writes the journal header, recording that the log is empty and
+   the next transaction written to it will be number SEQ, along
+   with the hot sectors. */
+static void
+write_header (unsigned seq)
+{
+  enum iotrace_kind kind;
+
+  memset (&log_block, 0, sizeof log_block);
+  log_block.magic = JOURNAL_MAGIC;
+  log_block.seq = seq;
+  log_block.block_sectors = fs_block_sectors;
+  log_block.cnt = warm_cnt;
+  memcpy (log_block.sectors, warm, warm_cnt * sizeof *warm);
+  kind = iotrace_set_kind (IOTRACE_JOURNAL);
+  block_write (fs_device, JOURNAL_SECTOR, &log_block);
+  iotrace_set_kind (kind);
+}
+
+/* Completion callback for a checkpoint write. */
+static void
+checkpoint_done (struct block_request *req)
+{
+  sema_up (req->aux);
+}
+
+/* Writes every committed image home and empties the log, so that
+   transaction SEQ is the next one written to it.
+   The caller must hold commit_lock. */
+static void
+checkpoint (unsigned seq)
+{
+  struct semaphore done;
+  struct list_elem *e;
+  enum iotrace_kind kind;
+
+  sema_init (&done, 0);
+  ASSERT (lock_held_by_current_thread (&commit_lock));
+
+  /* Queue the writes together so that the disk can sort them. */
+  kind = iotrace_set_kind (IOTRACE_META);
+  for (e = list_begin (&checkpoint_list); e != list_end (&checkpoint_list);
+       e = list_next (e))
+    {
+      struct journal_image *image = list_entry (e, struct journal_image,
+                                                elem);
+      image->req.sector = image->sector;
+      image->req.cnt = 1;
+      image->req.buffer = image->data;
+      image->req.write = true;
+      image->req.done = checkpoint_done;
+      image->req.aux = &done;
+      block_submit (fs_device, &image->req);
+    }
+  iotrace_set_kind (kind);
+  while (!list_empty (&checkpoint_list))
+    {
+      sema_down (&done);
+      free (list_entry (list_pop_front (&checkpoint_list),
+                        struct journal_image, elem));
+    }
+  write_header (seq);
+  log_used = 0;
+}
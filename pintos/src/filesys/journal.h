@@ -0,0 +1,18 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+#include "filesys/ondisk.h"
+
+void journal_init (bool format);
+void journal_done (void);
+void journal_write (block_sector_t sector, void *buffer,
+                    off_t start, off_t end, block_sector_t owner);
+void journal_commit (void);
+void journal_revoke (block_sector_t sector);
+size_t journal_get_warm (block_sector_t *sectors);
+void journal_set_warm (const block_sector_t *sectors, size_t cnt);
+
+#endif /* filesys/journal.h */
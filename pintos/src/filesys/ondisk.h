@@ -0,0 +1,115 @@
+#ifndef FILESYS_ONDISK_H
+#define FILESYS_ONDISK_H
+
+/* On-disk layout of the file system.
+
+   This header is shared with the host-side utils/pintos-fs tool,
+   so it must not depend on anything but <stdbool.h> and
+   <stdint.h>.  All sectors are 512 bytes.
+
+   File data and index blocks are allocated in file system blocks
+   of one or more consecutive sectors, a size chosen when the file
+   system is formatted and recorded in the journal header.  Inodes
+   always take a single sector. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sectors of system file inodes. */
+#define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
+#define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Metadata journal header sector. */
+
+/* The journal occupies a fixed run of sectors starting at
+   JOURNAL_SECTOR: one header sector followed by the log. */
+#define JOURNAL_LOG_SECTORS 63
+#define JOURNAL_SECTORS (1 + JOURNAL_LOG_SECTORS)
+
+/* Largest file system block, in sectors.  A block must fit in a
+   4 kB page, and the number of sectors in it is a power of 2. */
+#define FS_BLOCK_SECTORS_MAX 8
+
+/* Identifies an inode. */
+#define INODE_MAGIC 0x494e4f44
+
+#define NUM_DIRECT_PTRS 12
+
+/* Byte offset of the inline flag in the on-disk inode, just past
+   the magic.  When the flag is set, the file's contents live in
+   the rest of the inode sector instead of in data sectors, and
+   every block pointer is zero. */
+#define INODE_INLINE_FLAG_OFS (8 + 4 * NUM_DIRECT_PTRS + 12)
+#define INODE_INLINE_DATA_OFS (INODE_INLINE_FLAG_OFS + 4)
+
+/* Largest file, in bytes, that is stored inline.  Directories are
+   never inline. */
+#define INODE_INLINE_MAX (512 - INODE_INLINE_DATA_OFS)
+
+/* On-disk inode.  The kernel reads and writes it field by field
+   at these offsets through the buffer cache.  Data block I of a
+   file is found through direct[I] for the first NUM_DIRECT_PTRS
+   blocks, then through the single indirect block, then through
+   the double indirect block, each index block holding 128 block
+   pointers per sector.  A block pointer is the number of the
+   block's first sector. */
+struct inode_disk
+  {
+    int32_t length;                     /* File size in bytes. */
+    uint32_t is_dir;                    /* Nonzero for directories. */
+    uint32_t direct[NUM_DIRECT_PTRS];   /* Direct data sectors. */
+    uint32_t single;                    /* Single indirect block. */
+    uint32_t dbl;                       /* Double indirect block. */
+    uint32_t magic;                     /* INODE_MAGIC. */
+    uint32_t is_inline;                 /* Data stored in DATA? */
+    uint8_t data[INODE_INLINE_MAX];     /* Inline file contents. */
+  };
+
+/* Maximum length of a file name component. */
+#define DIR_NAME_MAX 14
+
+/* Entries the root directory is created with. */
+#define ROOT_DIR_ENTRIES 16
+
+/* A single directory entry.  A directory's contents are an array
+   of these.  Every directory but the root starts with "." and ".."
+   entries. */
+struct dir_entry
+  {
+    uint32_t inode_sector;              /* Sector number of header. */
+    char name[DIR_NAME_MAX + 1];        /* Null terminated file name. */
+    bool in_use;                        /* In use or free? */
+  };
+
+/* The free map is a regular file whose inode is in FREE_MAP_SECTOR.
+   Bit I of its contents, counting from the least significant bit
+   of each little-endian 32-bit word, is set if sector I is in use.
+   The bitmap is followed by one byte per sector counting the
+   references to that sector beyond the first, for data sectors
+   shared between files.  Older file systems lack the counts and
+   share nothing. */
+
+/* Identifies the journal header, descriptors and commit records. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define JOURNAL_DESC_MAGIC 0x4a444553
+#define JOURNAL_COMMIT_MAGIC 0x4a434d54
+
+/* Most hot sectors listed in the journal header. */
+#define JOURNAL_WARM_MAX 64
+
+/* On-disk journal header, descriptor or commit record.
+   The header names the sequence number of the first transaction
+   in the log and the file system block size, and lists in CNT and
+   SECTORS up to JOURNAL_WARM_MAX sectors that were hot in the
+   buffer cache at the last clean shutdown, hottest first, to be
+   read back in at mount.  Each transaction is a descriptor, the
+   images of the CNT sectors it names, and a commit record. */
+struct journal_block
+  {
+    uint32_t magic;                     /* One of the magics above. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors logged. */
+    uint32_t block_sectors;             /* Header: sectors per block, 0 for 1. */
+    uint32_t sectors[124];              /* Home of each logged sector. */
+  };
+
+#endif /* filesys/ondisk.h */
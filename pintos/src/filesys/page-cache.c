@@ -0,0 +1,678 @@
+#include "filesys/page-cache.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "devices/iotrace.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* Page cache for file data.
+
+   The contents of regular files are cached a page at a time,
+   keyed by the sector of the file's inode and the index of the
+   page in the file, in page frames that can be mapped straight
+   into user address spaces.  read(), write() and mmap() all go
+   through here, so they see a single copy of each page.  The
+   buffer cache in devices/block.c holds only metadata: inodes,
+   index blocks, directory contents and the free map, which are
+   written through the journal.
+
+   A page is filled a sector at a time as its sectors are used,
+   so a frame may hold some valid sectors and not others.  The
+   caller names the device sector behind each access, and the
+   cache remembers it for writing the sector back.
+
+   The buffer cache's counters are kept here too, one access per
+   read or write and one miss per sector brought in, so hit rates
+   mean the same as before.
+
+   Dirty pages are kept in check so that a process streaming
+   writes cannot fill the cache with them and leave every other
+   process's misses to write them back.  Eviction passes over
+   dirty pages while clean ones are to be had, and a write that
+   dirties a page while more than DIRTY_MAX pages are dirty makes
+   its writer write back its own other dirty pages first.
+
+   Mapped pages can't be evicted, so they are kept to MAPPED_MAX
+   pages: once that many are mapped, a process that maps another
+   gives back one of its own first.  That leaves read() and write()
+   frames to use even while a large file is scanned through mmap. */
+
+/* Number of pages in the cache.  Frames are allocated once, at
+   startup, so the cache does not compete with user processes
+   for memory later. */
+#define PAGE_CACHE_PAGES 32
+
+/* Number of dirty pages above which writers are throttled. */
+#define DIRTY_MAX (PAGE_CACHE_PAGES / 4)
+
+/* Number of mapped pages at which processes map no more pages
+   without giving one back. */
+#define MAPPED_MAX (PAGE_CACHE_PAGES / 2)
+
+/* Owner of a page that holds nothing. */
+#define PAGE_FREE BUFFER_NO_OWNER
+
+/* A cached page of file data. */
+struct cache_page
+  {
+    block_sector_t owner;               /* Inode sector, or PAGE_FREE. */
+    size_t page;                        /* Index of the page in the file. */
+    uint8_t *frame;                     /* Page frame. */
+    block_sector_t sectors[PAGE_SECTORS]; /* Device sector of each slot. */
+    uint8_t valid;                      /* Bit I set: slot I holds data. */
+    uint8_t dirty;                      /* Bit I set: slot I needs writing. */
+    bool accessed;                      /* Used since the clock hand passed? */
+    int map_cnt;                        /* Number of user mappings. */
+    struct lock lock;                   /* Guards the contents. */
+  };
+
+static struct cache_page pages[PAGE_CACHE_PAGES];
+
+/* Guards OWNER and PAGE of every page, and the clock hand.
+   A page's lock is only ever acquired with this lock held, so a
+   page found under it keeps its identity until its lock is
+   released. */
+static struct lock cache_lock;
+static size_t hand;
+
+extern int g_buffer_misses, g_buffer_accesses;
+
+/* Allocates the cache's frames. */
+void
+page_cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    {
+      struct cache_page *p = &pages[i];
+      p->owner = PAGE_FREE;
+      p->frame = palloc_get_page (PAL_ASSERT);
+      p->valid = p->dirty = 0;
+      p->accessed = false;
+      p->map_cnt = 0;
+      lock_init (&p->lock);
+    }
+  hand = 0;
+}
+
+/* Returns the address of slot SLOT of P. */
+static uint8_t *
+slot_addr (struct cache_page *p, int slot)
+{
+  return p->frame + slot * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads CNT sectors of file data starting at SECTOR into
+   BUFFER. */
+static void
+read_data (block_sector_t sector, block_sector_t cnt, void *buffer)
+{
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_DATA);
+  block_read_multiple (fs_device, sector, cnt, buffer);
+  iotrace_set_kind (kind);
+}
+
+/* Writes CNT sectors of file data starting at SECTOR from
+   BUFFER. */
+static void
+write_data (block_sector_t sector, block_sector_t cnt, const void *buffer)
+{
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_DATA);
+  block_write_multiple (fs_device, sector, cnt, buffer);
+  iotrace_set_kind (kind);
+}
+
+/* A write of a run of dirty slots, queued by queue_write_back(). */
+struct write_run
+  {
+    struct block_request req;           /* The queued write. */
+    struct list_elem elem;              /* Element in the caller's list. */
+  };
+
+/* Completion callback for a write_run: ups the semaphore it
+   names. */
+static void
+write_run_done (struct block_request *req)
+{
+  sema_up (req->aux);
+}
+
+/* Queues writes of the dirty slots of P, one for each run of
+   dirty slots over consecutive sectors, adding them to RUNS.
+   DONE is upped as each completes.  The slots' contents must not
+   change until wait_write_back() returns for RUNS, so the caller
+   must hold P's lock until then. */
+static void
+queue_write_back (struct cache_page *p, struct list *runs,
+                  struct semaphore *done)
+{
+  enum iotrace_kind kind = iotrace_set_kind (IOTRACE_DATA);
+  int slot, end;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  for (slot = 0; slot < PAGE_SECTORS; slot = end)
+    {
+      struct write_run *run;
+
+      end = slot + 1;
+      if (!(p->dirty & (1 << slot)))
+        continue;
+      while (end < PAGE_SECTORS && (p->dirty & (1 << end))
+             && p->sectors[end] == p->sectors[end - 1] + 1)
+        end++;
+      run = malloc (sizeof *run);
+      if (run == NULL)
+        PANIC ("out of memory for file I/O");
+      run->req.sector = p->sectors[slot];
+      run->req.cnt = end - slot;
+      run->req.buffer = slot_addr (p, slot);
+      run->req.write = true;
+      run->req.done = write_run_done;
+      run->req.aux = done;
+      list_push_back (runs, &run->elem);
+      block_submit (fs_device, &run->req);
+    }
+  p->dirty = 0;
+  iotrace_set_kind (kind);
+}
+
+/* Waits for every write in RUNS, queued by queue_write_back()
+   with DONE, to complete, and frees them. */
+static void
+wait_write_back (struct list *runs, struct semaphore *done)
+{
+  while (!list_empty (runs))
+    {
+      sema_down (done);
+      free (list_entry (list_pop_front (runs), struct write_run, elem));
+    }
+}
+
+/* Writes the dirty slots of P back to disk.
+   The caller must hold P's lock. */
+static void
+write_back (struct cache_page *p)
+{
+  struct list runs;
+  struct semaphore done;
+
+  list_init (&runs);
+  sema_init (&done, 0);
+  queue_write_back (p, &runs, &done);
+  wait_write_back (&runs, &done);
+}
+
+/* Writes back the dirty pages of the file whose inode is in
+   OWNER, except page SKIP, leaving them cached.  The writes are
+   all queued at once, so the disk can sort and merge them. */
+static void
+flush_owner (block_sector_t owner, size_t skip)
+{
+  struct cache_page *locked[PAGE_CACHE_PAGES];
+  struct list runs;
+  struct semaphore done;
+  size_t i, cnt = 0;
+
+  list_init (&runs);
+  sema_init (&done, 0);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    {
+      struct cache_page *p = &pages[i];
+
+      if (p->owner != owner || p->page == skip || p->dirty == 0)
+        continue;
+      lock_acquire (&p->lock);
+      queue_write_back (p, &runs, &done);
+      locked[cnt++] = p;
+    }
+  lock_release (&cache_lock);
+
+  wait_write_back (&runs, &done);
+  for (i = 0; i < cnt; i++)
+    lock_release (&locked[i]->lock);
+}
+
+/* Returns the number of dirty pages.  The count is only a
+   snapshot, since no page locks are taken. */
+static size_t
+count_dirty (void)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    if (pages[i].dirty != 0)
+      cnt++;
+  return cnt;
+}
+
+/* Returns page PAGE of the file whose inode is in OWNER, locked,
+   or a null pointer if it is not cached.
+   The caller must hold cache_lock. */
+static struct cache_page *
+lookup (block_sector_t owner, size_t page)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    if (pages[i].owner == owner && pages[i].page == page)
+      {
+        lock_acquire (&pages[i].lock);
+        return &pages[i];
+      }
+  return NULL;
+}
+
+/* Chooses a page to reuse with the clock algorithm, writes back
+   its dirty slots and returns it, locked.  Mapped pages and
+   pages in use are passed over, and dirty pages are too for the
+   first two turns of the clock, so that a miss seldom has to
+   wait for a write; if nothing is found after a third turn,
+   returns a null pointer.
+   The caller must hold cache_lock. */
+static struct cache_page *
+evict (void)
+{
+  size_t n;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (n = 0; n < 3 * PAGE_CACHE_PAGES; n++)
+    {
+      struct cache_page *p = &pages[hand];
+      hand = (hand + 1) % PAGE_CACHE_PAGES;
+
+      if (p->map_cnt > 0 || !lock_try_acquire (&p->lock))
+        continue;
+      if (p->map_cnt > 0 || (p->owner != PAGE_FREE && p->accessed))
+        {
+          p->accessed = false;
+          lock_release (&p->lock);
+          continue;
+        }
+      if (p->dirty != 0 && n < 2 * PAGE_CACHE_PAGES)
+        {
+          lock_release (&p->lock);
+          continue;
+        }
+      write_back (p);
+      return p;
+    }
+  return NULL;
+}
+
+/* Returns page PAGE of the file whose inode is in OWNER, locked,
+   making room for it in the cache if necessary.
+   If there is no room, returns a null pointer and leaves
+   cache_lock held, so that the caller can go to the disk without
+   another thread caching the page meanwhile. */
+static struct cache_page *
+get_page (block_sector_t owner, size_t page)
+{
+  struct cache_page *p;
+
+  lock_acquire (&cache_lock);
+  p = lookup (owner, page);
+  if (p == NULL)
+    {
+      p = evict ();
+      if (p == NULL)
+        return NULL;
+      p->owner = owner;
+      p->page = page;
+      p->valid = p->dirty = 0;
+    }
+  p->accessed = true;
+  lock_release (&cache_lock);
+  return p;
+}
+
+/* Makes slot SLOT of P hold SECTOR.  Unless WHOLE, in which case
+   the caller is about to overwrite all of it, reads the sector
+   in if the slot does not hold it yet, along with the rest of the
+   file system block it belongs to, whose sectors are consecutive
+   on disk and fill consecutive slots.  Each run of missing slots
+   is read with a single request. */
+static void
+fill (struct cache_page *p, int slot, block_sector_t sector, bool whole)
+{
+  int last = slot - slot % fs_block_sectors + fs_block_sectors;
+  int i, end;
+
+  if (p->valid & (1 << slot))
+    {
+      ASSERT (p->sectors[slot] == sector);
+      return;
+    }
+  if (whole)
+    {
+      g_buffer_misses++;
+      p->sectors[slot] = sector;
+      p->valid |= 1 << slot;
+      return;
+    }
+  for (i = last - fs_block_sectors; i < last; i = end)
+    {
+      end = i + 1;
+      if (p->valid & (1 << i))
+        continue;
+      while (end < last && !(p->valid & (1 << end)))
+        end++;
+      read_data (sector - slot + i, end - i, slot_addr (p, i));
+      for (; i < end; i++)
+        {
+          g_buffer_misses++;
+          p->sectors[i] = sector - slot + i;
+          p->valid |= 1 << i;
+        }
+    }
+}
+
+/* Reads or writes SIZE bytes at offset OFS in SECTOR straight
+   from or to the disk, for when the cache has no room.
+   The caller must hold cache_lock, which is released. */
+static void
+transfer_uncached (block_sector_t sector, int ofs, void *buffer, off_t size,
+                   bool writing)
+{
+  uint8_t *bounce = malloc (BLOCK_SECTOR_SIZE);
+
+  if (bounce == NULL)
+    PANIC ("out of memory for file I/O");
+  g_buffer_misses++;
+  iotrace_record (fs_device, IOTRACE_MISS, IOTRACE_DATA, sector, 1);
+  if (!writing || ofs != 0 || size != BLOCK_SECTOR_SIZE)
+    read_data (sector, 1, bounce);
+  if (writing)
+    {
+      memcpy (bounce + ofs, buffer, size);
+      write_data (sector, 1, bounce);
+    }
+  else
+    memcpy (buffer, bounce + ofs, size);
+  lock_release (&cache_lock);
+  free (bounce);
+}
+
+/* Reads SIZE bytes at byte offset POS in the file whose inode is
+   in OWNER into BUFFER.  The bytes must lie within a single
+   sector, which is SECTOR on the device. */
+void
+page_cache_read (block_sector_t owner, off_t pos, block_sector_t sector,
+                 void *buffer, off_t size)
+{
+  int slot = pos % PGSIZE / BLOCK_SECTOR_SIZE;
+  int ofs = pos % BLOCK_SECTOR_SIZE;
+  struct cache_page *p;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  g_buffer_accesses++;
+  p = get_page (owner, pos / PGSIZE);
+  if (p == NULL)
+    {
+      transfer_uncached (sector, ofs, buffer, size, false);
+      return;
+    }
+  iotrace_record (fs_device,
+                  p->valid & (1 << slot) ? IOTRACE_HIT : IOTRACE_MISS,
+                  IOTRACE_DATA, sector, 1);
+  fill (p, slot, sector, false);
+  memcpy (buffer, slot_addr (p, slot) + ofs, size);
+  lock_release (&p->lock);
+}
+
+/* Writes SIZE bytes from BUFFER at byte offset POS in the file
+   whose inode is in OWNER.  The bytes must lie within a single
+   sector, which is SECTOR on the device. */
+void
+page_cache_write (block_sector_t owner, off_t pos, block_sector_t sector,
+                  const void *buffer, off_t size)
+{
+  int slot = pos % PGSIZE / BLOCK_SECTOR_SIZE;
+  int ofs = pos % BLOCK_SECTOR_SIZE;
+  struct cache_page *p;
+  bool was_clean;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  g_buffer_accesses++;
+  p = get_page (owner, pos / PGSIZE);
+  if (p == NULL)
+    {
+      transfer_uncached (sector, ofs, (void *) buffer, size, true);
+      return;
+    }
+  iotrace_record (fs_device,
+                  p->valid & (1 << slot) ? IOTRACE_HIT : IOTRACE_MISS,
+                  IOTRACE_DATA, sector, 1);
+  fill (p, slot, sector, ofs == 0 && size == BLOCK_SECTOR_SIZE);
+  memcpy (slot_addr (p, slot) + ofs, buffer, size);
+  was_clean = p->dirty == 0;
+  p->dirty |= 1 << slot;
+  lock_release (&p->lock);
+
+  /* Throttle a writer that leaves too much dirty data behind.
+     The page being written is left alone, so that a sequential
+     writer does not write out pages it has yet to finish. */
+  if (was_clean && count_dirty () > DIRTY_MAX)
+    flush_owner (owner, pos / PGSIZE);
+}
+
+/* Records that newly allocated SECTOR is data sector IDX of the
+   file whose inode is in OWNER, and zeroes it. */
+void
+page_cache_zero (block_sector_t owner, size_t idx, block_sector_t sector)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  int slot = idx % PAGE_SECTORS;
+  struct cache_page *p;
+
+  p = get_page (owner, idx / PAGE_SECTORS);
+  if (p == NULL)
+    {
+      write_data (sector, 1, zeros);
+      lock_release (&cache_lock);
+      return;
+    }
+  memset (slot_addr (p, slot), 0, BLOCK_SECTOR_SIZE);
+  p->sectors[slot] = sector;
+  p->valid |= 1 << slot;
+  p->dirty |= 1 << slot;
+  lock_release (&p->lock);
+}
+
+/* Moves data sector IDX of the file whose inode is in OWNER
+   from device sector OLD to newly allocated sector NEW, which
+   gets a copy of its contents, cached ones included.  OLD itself
+   is left as it is. */
+void
+page_cache_move (block_sector_t owner, size_t idx, block_sector_t old,
+                 block_sector_t new)
+{
+  int slot = idx % PAGE_SECTORS;
+  struct cache_page *p;
+
+  p = get_page (owner, idx / PAGE_SECTORS);
+  if (p == NULL)
+    {
+      uint8_t *bounce = malloc (BLOCK_SECTOR_SIZE);
+
+      if (bounce == NULL)
+        PANIC ("out of memory for file I/O");
+      read_data (old, 1, bounce);
+      write_data (new, 1, bounce);
+      lock_release (&cache_lock);
+      free (bounce);
+      return;
+    }
+  fill (p, slot, old, false);
+  p->sectors[slot] = new;
+  p->dirty |= 1 << slot;
+  lock_release (&p->lock);
+}
+
+/* Returns the frame of the page at byte offset POS in the file
+   whose inode is in OWNER, for mapping into a user address
+   space, with every slot for which SECTORS names a device sector
+   read in and every other slot zeroed.  The page stays in the
+   cache until page_cache_unmap() is called for it.
+   Returns a null pointer if the cache has no room. */
+void *
+page_cache_map (block_sector_t owner, off_t pos,
+                const block_sector_t sectors[PAGE_SECTORS])
+{
+  struct cache_page *p;
+  int slot;
+
+  ASSERT (pos % PGSIZE == 0);
+  p = get_page (owner, pos / PGSIZE);
+  if (p == NULL)
+    {
+      lock_release (&cache_lock);
+      return NULL;
+    }
+  for (slot = 0; slot < PAGE_SECTORS; slot++)
+    if (sectors[slot] != 0)
+      fill (p, slot, sectors[slot], false);
+    else if (!(p->valid & (1 << slot)))
+      memset (slot_addr (p, slot), 0, BLOCK_SECTOR_SIZE);
+  p->map_cnt++;
+  lock_release (&p->lock);
+  return p->frame;
+}
+
+/* Drops one mapping of the page at byte offset POS in the file
+   whose inode is in OWNER.  If DIRTY, the mapping wrote to the
+   page, so all of its valid slots must be written back. */
+void
+page_cache_unmap (block_sector_t owner, off_t pos, bool dirty)
+{
+  struct cache_page *p;
+
+  lock_acquire (&cache_lock);
+  p = lookup (owner, pos / PGSIZE);
+  lock_release (&cache_lock);
+
+  ASSERT (p != NULL && p->map_cnt > 0);
+  p->map_cnt--;
+  if (dirty)
+    p->dirty |= p->valid;
+  lock_release (&p->lock);
+}
+
+/* Returns true if the page at byte offset POS in the file whose
+   inode is in OWNER is mapped into a user address space. */
+bool
+page_cache_is_mapped (block_sector_t owner, off_t pos)
+{
+  struct cache_page *p;
+  bool mapped;
+
+  lock_acquire (&cache_lock);
+  p = lookup (owner, pos / PGSIZE);
+  lock_release (&cache_lock);
+  if (p == NULL)
+    return false;
+  mapped = p->map_cnt > 0;
+  lock_release (&p->lock);
+  return mapped;
+}
+
+/* Marks every valid slot of the page at byte offset POS in the
+   file whose inode is in OWNER dirty, if it is mapped, since its
+   mappings may have written to any of them.  The page stays
+   mapped. */
+void
+page_cache_dirty_mapped (block_sector_t owner, off_t pos)
+{
+  struct cache_page *p;
+
+  lock_acquire (&cache_lock);
+  p = lookup (owner, pos / PGSIZE);
+  lock_release (&cache_lock);
+  if (p == NULL)
+    return;
+  if (p->map_cnt > 0)
+    p->dirty |= p->valid;
+  lock_release (&p->lock);
+}
+
+/* Returns true if as many pages are mapped as should be, in
+   which case a process should unmap one of its own pages before
+   mapping another.  The answer is only a snapshot, since no page
+   locks are taken. */
+bool
+page_cache_map_full (void)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    if (pages[i].map_cnt > 0)
+      cnt++;
+  return cnt >= MAPPED_MAX;
+}
+
+/* Writes back the dirty pages of the file whose inode is in
+   OWNER, leaving them cached.  The writes are all queued at once,
+   so the disk can sort and merge them. */
+void
+page_cache_flush (block_sector_t owner)
+{
+  flush_owner (owner, (size_t) -1);
+}
+
+/* Writes back every dirty page and empties the cache of all but
+   mapped pages. */
+void
+page_cache_flush_all (void)
+{
+  struct list runs;
+  struct semaphore done;
+  size_t i;
+
+  list_init (&runs);
+  sema_init (&done, 0);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    {
+      lock_acquire (&pages[i].lock);
+      queue_write_back (&pages[i], &runs, &done);
+    }
+  wait_write_back (&runs, &done);
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    {
+      struct cache_page *p = &pages[i];
+
+      if (p->map_cnt == 0)
+        p->owner = PAGE_FREE;
+      lock_release (&p->lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Discards the pages of the file whose inode is in OWNER without
+   writing them back, because its sectors are being freed. */
+void
+page_cache_drop (block_sector_t owner)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < PAGE_CACHE_PAGES; i++)
+    {
+      struct cache_page *p = &pages[i];
+
+      if (p->owner != owner)
+        continue;
+      lock_acquire (&p->lock);
+      ASSERT (p->map_cnt == 0);
+      p->owner = PAGE_FREE;
+      p->dirty = 0;
+      lock_release (&p->lock);
+    }
+  lock_release (&cache_lock);
+}
@@ -0,0 +1,31 @@
+#ifndef FILESYS_PAGE_CACHE_H
+#define FILESYS_PAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+#include "threads/vaddr.h"
+
+/* Sectors in one page of file data. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+void page_cache_init (void);
+void page_cache_read (block_sector_t owner, off_t pos, block_sector_t sector,
+                      void *buffer, off_t size);
+void page_cache_write (block_sector_t owner, off_t pos, block_sector_t sector,
+                       const void *buffer, off_t size);
+void page_cache_zero (block_sector_t owner, size_t idx, block_sector_t sector);
+void page_cache_move (block_sector_t owner, size_t idx, block_sector_t old,
+                      block_sector_t new);
+void *page_cache_map (block_sector_t owner, off_t pos,
+                      const block_sector_t sectors[PAGE_SECTORS]);
+void page_cache_unmap (block_sector_t owner, off_t pos, bool dirty);
+bool page_cache_map_full (void);
+bool page_cache_is_mapped (block_sector_t owner, off_t pos);
+void page_cache_dirty_mapped (block_sector_t owner, off_t pos);
+void page_cache_flush (block_sector_t owner);
+void page_cache_flush_all (void);
+void page_cache_drop (block_sector_t owner);
+
+#endif /* filesys/page-cache.h */
@@ -358,6 +358,26 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to FILE, at the same file offset bitmap_write() would use.
+   Returns true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  off_t ofs, size;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  ofs = elem_idx (start) * sizeof (elem_type);
+  size = (elem_idx (start + cnt - 1) + 1) * sizeof (elem_type) - ofs;
+  return file_write_at (file, (uint8_t *) b->bits + ofs, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -39,6 +39,18 @@ enum
     
     SYS_DEVICE_WRITES,
     SYS_DEVICE_READS,
+
+    /* Extended file system calls. */
+    SYS_GETDENTS,               /* Reads many directory entries at once. */
+    SYS_STAT,                   /* Obtain a file's metadata by name. */
+    SYS_FSTAT,                  /* Obtain a file's metadata by fd. */
+    SYS_FSYNC,                  /* Write a file and its metadata to disk. */
+    SYS_FDATASYNC,              /* Write a file's data to disk. */
+    SYS_CLONE_FILE,             /* Share a file's data with a new file. */
+    SYS_COPY_FILE_RANGE,        /* Copy bytes between files in the kernel. */
+
+    /* Benchmarking. */
+    SYS_TICKS,                  /* Timer ticks since boot. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -61,6 +61,26 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0 through ARG4,
+   and returns the return value as an `int'. */
+#define syscall5(NUMBER, ARG0, ARG1, ARG2, ARG3, ARG4)          \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg4]; pushl %[arg3]; pushl %[arg2]; "    \
+             "pushl %[arg1]; pushl %[arg0]; "                   \
+             "pushl %[number]; int $0x30; addl $24, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3),                             \
+                 [arg4] "r" (ARG4)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 int
 practice (int i)
 {
@@ -147,6 +167,18 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+mapid_t
+mmap (int fd, void *addr)
+{
+  return syscall2 (SYS_MMAP, fd, addr);
+}
+
+void
+munmap (mapid_t mapid)
+{
+  syscall1 (SYS_MUNMAP, mapid);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -211,4 +243,53 @@ int
 device_reads (void)
 {
   return syscall0 (SYS_DEVICE_READS);
-}
\ No newline at end of file
+}
+
+int
+getdents (int fd, struct dirent *entries, unsigned size)
+{
+  return syscall3 (SYS_GETDENTS, fd, entries, size);
+}
+
+bool
+stat (const char *file, struct stat *st)
+{
+  return syscall2 (SYS_STAT, file, st);
+}
+
+bool
+fstat (int fd, struct stat *st)
+{
+  return syscall2 (SYS_FSTAT, fd, st);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
+
+bool
+clone_file (const char *src, const char *dst)
+{
+  return syscall2 (SYS_CLONE_FILE, src, dst);
+}
+
+int
+copy_file_range (int in_fd, unsigned in_ofs, int out_fd, unsigned out_ofs,
+                 unsigned size)
+{
+  return syscall5 (SYS_COPY_FILE_RANGE, in_fd, in_ofs, out_fd, out_ofs, size);
+}
+
+int
+ticks (void)
+{
+  return syscall0 (SYS_TICKS);
+}
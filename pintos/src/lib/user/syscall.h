@@ -40,6 +40,10 @@ int buffer_miss_count (void);
 void buffer_stats_reset (void);
 void buffer_reset (void);
 
+/* Project 3 and optionally project 4. */
+mapid_t mmap (int fd, void *addr);
+void munmap (mapid_t);
+
 /* Project 4 only. */
 bool chdir (const char *dir);
 bool mkdir (const char *dir);
@@ -47,8 +51,38 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* One directory entry as filled in by getdents(). */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    unsigned size;                      /* File size in bytes. */
+    bool is_dir;                        /* Is it a directory? */
+    char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+  };
+
+int getdents (int fd, struct dirent *entries, unsigned size);
+
+/* File metadata as filled in by stat() and fstat(). */
+struct stat
+  {
+    int inumber;                        /* Inode number. */
+    unsigned size;                      /* File size in bytes. */
+    bool is_dir;                        /* Is it a directory? */
+  };
+
+bool stat (const char *file, struct stat *st);
+bool fstat (int fd, struct stat *st);
+bool fsync (int fd);
+bool fdatasync (int fd);
+bool clone_file (const char *src, const char *dst);
+int copy_file_range (int in_fd, unsigned in_ofs, int out_fd, unsigned out_ofs,
+                     unsigned size);
+
 /* For Student Test 2 */
 int device_writes (void);
 int device_reads (void);
 
+/* Benchmarking. */
+int ticks (void);
+
 #endif /* lib/user/syscall.h */
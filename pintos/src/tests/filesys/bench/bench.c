@@ -0,0 +1,61 @@
+/* Measurement harness for the file system benchmarks.
+
+   Each measurement prints a single line of the form
+
+     (TEST) BENCH NAME ticks=T bytes=B ops=O bytes_per_sec=R
+       ops_per_sec=P buf_accesses=A buf_misses=M dev_reads=DR
+       dev_writes=DW
+
+   (all on one line), where every value is a decimal integer and
+   the counters are the change over the measurement.  Rates are 0
+   when the measurement took less than one tick. */
+
+#include "tests/filesys/bench/bench.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Samples the counters into B and names the measurement NAME. */
+void
+bench_start (struct bench *b, const char *name)
+{
+  b->name = name;
+  b->accesses = buffer_accesses ();
+  b->misses = buffer_miss_count ();
+  b->dev_reads = device_reads ();
+  b->dev_writes = device_writes ();
+  b->ticks = ticks ();
+}
+
+/* Ends the measurement started with B, which moved BYTES bytes
+   of file data in OPS operations, and reports it. */
+void
+bench_end (struct bench *b, long long bytes, int ops)
+{
+  int elapsed = ticks () - b->ticks;
+  int accesses = buffer_accesses () - b->accesses;
+  int misses = buffer_miss_count () - b->misses;
+  int dev_reads = device_reads () - b->dev_reads;
+  int dev_writes = device_writes () - b->dev_writes;
+  long long bytes_per_sec = 0;
+  long long ops_per_sec = 0;
+
+  if (elapsed > 0)
+    {
+      bytes_per_sec = bytes * BENCH_TICKS_PER_SEC / elapsed;
+      ops_per_sec = (long long) ops * BENCH_TICKS_PER_SEC / elapsed;
+    }
+  msg ("BENCH %s ticks=%d bytes=%lld ops=%d bytes_per_sec=%lld "
+       "ops_per_sec=%lld buf_accesses=%d buf_misses=%d "
+       "dev_reads=%d dev_writes=%d",
+       b->name, elapsed, bytes, ops, bytes_per_sec, ops_per_sec,
+       accesses, misses, dev_reads, dev_writes);
+}
+
+/* Writes back and empties the buffer cache, so that the next
+   measurement starts cold. */
+void
+bench_cold (void)
+{
+  buffer_reset ();
+}
+
@@ -0,0 +1,22 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_H
+#define TESTS_FILESYS_BENCH_BENCH_H
+
+/* Timer ticks per second, as TIMER_FREQ in devices/timer.h. */
+#define BENCH_TICKS_PER_SEC 100
+
+/* Counters sampled at the start of a measurement. */
+struct bench
+  {
+    const char *name;           /* Benchmark name. */
+    int ticks;                  /* Timer ticks. */
+    int accesses;               /* Buffer cache accesses. */
+    int misses;                 /* Buffer cache misses. */
+    int dev_reads;              /* File system device reads. */
+    int dev_writes;             /* File system device writes. */
+  };
+
+void bench_start (struct bench *, const char *name);
+void bench_end (struct bench *, long long bytes, int ops);
+void bench_cold (void);
+
+#endif /* tests/filesys/bench/bench.h */
@@ -0,0 +1,27 @@
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks that a benchmark ran to completion and reported a
+# well-formed result line for each measurement named in @_.
+# The measured values themselves are not checked.
+sub check_bench {
+    my (@names) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    my ($fields) = join (' ', map ("$_=\\d+",
+			   qw (ticks bytes ops bytes_per_sec ops_per_sec
+			       buf_accesses buf_misses dev_reads dev_writes)));
+    foreach my $name (@names) {
+	fail "Missing or malformed result for \"$name\"\n"
+	  if !grep (/^\(\S+\) BENCH \Q$name\E $fields$/, @output);
+    }
+    fail "Benchmark didn't finish: no \"end\" message\n"
+      if !grep (/^\(\S+\) end$/, @output);
+    pass;
+}
+
+1;
@@ -0,0 +1,58 @@
+/* Child process for the mixed benchmark.  Writes a file of its
+   own, reads the shared file at random offsets, and creates and
+   removes small files. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/bench/mixed.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-mixed";
+
+static char buf[WRITE_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  char file_name[32];
+  int child_idx;
+  size_t ofs;
+  int fd, i;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  random_init (child_idx);
+
+  snprintf (file_name, sizeof file_name, "own-%d", child_idx);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < OWN_SIZE; ofs += WRITE_SIZE)
+    CHECK (write (fd, buf, WRITE_SIZE) == WRITE_SIZE,
+           "write %d bytes at offset %zu in \"%s\"",
+           WRITE_SIZE, ofs, file_name);
+  close (fd);
+
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  for (i = 0; i < READ_CNT; i++)
+    {
+      ofs = random_ulong () % (SHARED_SIZE / READ_SIZE) * READ_SIZE;
+      seek (fd, ofs);
+      CHECK (read (fd, buf, READ_SIZE) == READ_SIZE,
+             "read %d bytes at offset %zu in \"%s\"",
+             READ_SIZE, ofs, shared_name);
+    }
+  close (fd);
+
+  for (i = 0; i < SMALL_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "small-%d-%d", child_idx, i);
+      CHECK (create (file_name, 100), "create \"%s\"", file_name);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,52 @@
+/* Measures creating, then deleting, many small files in one
+   directory. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+#define FILE_SIZE 100
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void)
+{
+  struct bench b;
+  char file_name[32];
+  int i;
+
+  CHECK (mkdir ("storm"), "mkdir \"storm\"");
+
+  bench_cold ();
+  bench_start (&b, "create-200x100");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "storm/f%d", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\"", file_name);
+      if ((fd = open (file_name)) < 2)
+        fail ("open \"%s\"", file_name);
+      if (write (fd, buf, sizeof buf) != sizeof buf)
+        fail ("write \"%s\"", file_name);
+      close (fd);
+    }
+  bench_end (&b, (long long) FILE_CNT * FILE_SIZE, FILE_CNT);
+
+  bench_cold ();
+  bench_start (&b, "delete-200x100");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "storm/f%d", i);
+      if (!remove (file_name))
+        fail ("remove \"%s\"", file_name);
+    }
+  bench_end (&b, 0, FILE_CNT);
+
+  CHECK (remove ("storm"), "remove \"storm\"");
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::bench::bench;
+check_bench (qw (create-200x100 delete-200x100));
@@ -0,0 +1,74 @@
+/* Measures looking up files at the bottom of shallow and deep
+   directory trees by absolute path. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAX_DEPTH 16
+#define LOOKUP_CNT 200
+
+/* Looks up PATH LOOKUP_CNT times each with open() and stat(),
+   starting from a cold buffer cache, and reports it. */
+static void
+lookups (const char *path, int depth)
+{
+  struct bench b;
+  struct stat st;
+  char name[64];
+  int i;
+
+  bench_cold ();
+  snprintf (name, sizeof name, "open-depth%d", depth);
+  bench_start (&b, name);
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      int fd = open (path);
+      if (fd < 2)
+        fail ("open \"%s\"", path);
+      close (fd);
+    }
+  bench_end (&b, 0, LOOKUP_CNT);
+
+  bench_cold ();
+  snprintf (name, sizeof name, "stat-depth%d", depth);
+  bench_start (&b, name);
+  for (i = 0; i < LOOKUP_CNT; i++)
+    if (!stat (path, &st))
+      fail ("stat \"%s\"", path);
+  bench_end (&b, 0, LOOKUP_CNT);
+}
+
+void
+test_main (void)
+{
+  char dir[MAX_DEPTH * 2 + 1] = "";
+  char path[sizeof dir + 8];
+  int depth;
+
+  for (depth = 1; depth <= MAX_DEPTH; depth++)
+    {
+      strlcat (dir, "/d", sizeof dir);
+      CHECK (mkdir (dir), "mkdir depth %d", depth);
+      if (depth == 1 || depth == 4 || depth == MAX_DEPTH)
+        {
+          snprintf (path, sizeof path, "%s/file", dir);
+          CHECK (create (path, 512), "create file at depth %d", depth);
+        }
+    }
+
+  for (depth = 1; depth <= MAX_DEPTH; depth++)
+    if (depth == 1 || depth == 4 || depth == MAX_DEPTH)
+      {
+        int i;
+
+        path[0] = '\0';
+        for (i = 0; i < depth; i++)
+          strlcat (path, "/d", sizeof path);
+        strlcat (path, "/file", sizeof path);
+        lookups (path, depth);
+      }
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::bench::bench;
+check_bench (qw (open-depth1 stat-depth1 open-depth4 stat-depth4 open-depth16 stat-depth16));
@@ -0,0 +1,58 @@
+/* Measures listing a directory with many entries with readdir()
+   and getdents(), and stat()ing every file in it. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 256
+
+void
+test_main (void)
+{
+  struct dirent entries[16];
+  char name[READDIR_MAX_LEN + 1];
+  char path[32];
+  struct bench b;
+  struct stat st;
+  int fd, cnt, batch, i;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (path, sizeof path, "big/f%d", i);
+      if (!create (path, 16))
+        fail ("create \"%s\"", path);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  bench_cold ();
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  bench_start (&b, "readdir-256");
+  for (cnt = 0; readdir (fd, name); cnt++)
+    continue;
+  bench_end (&b, 0, cnt);
+  close (fd);
+  CHECK (cnt == FILE_CNT, "readdir found %d entries", cnt);
+
+  bench_cold ();
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  bench_start (&b, "getdents-256");
+  for (cnt = 0; (batch = getdents (fd, entries, sizeof entries)) > 0; )
+    cnt += batch;
+  bench_end (&b, 0, cnt);
+  close (fd);
+  CHECK (cnt == FILE_CNT, "getdents found %d entries", cnt);
+
+  bench_cold ();
+  bench_start (&b, "stat-256");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (path, sizeof path, "big/f%d", i);
+      if (!stat (path, &st))
+        fail ("stat \"%s\"", path);
+    }
+  bench_end (&b, 0, FILE_CNT);
+}
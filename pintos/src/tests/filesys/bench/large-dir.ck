@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::bench::bench;
+check_bench (qw (readdir-256 getdents-256 stat-256));
@@ -0,0 +1,34 @@
+/* Measures several processes each writing a file of its own,
+   reading a shared file at random offsets and creating and
+   removing small files, all at once. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/filesys/bench/mixed.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[SHARED_SIZE];
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  struct bench b;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (shared_name, 0), "create \"%s\"", shared_name);
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", shared_name);
+  close (fd);
+
+  bench_cold ();
+  bench_start (&b, "mixed-4proc");
+  exec_children ("child-mixed", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+  bench_end (&b, (long long) CHILD_CNT * (OWN_SIZE + READ_CNT * READ_SIZE),
+             CHILD_CNT * (OWN_SIZE / WRITE_SIZE + READ_CNT + 2 * SMALL_CNT));
+}
@@ -0,0 +1,19 @@
+#ifndef TESTS_FILESYS_BENCH_MIXED_H
+#define TESTS_FILESYS_BENCH_MIXED_H
+
+#define CHILD_CNT 4
+
+/* File read by every child. */
+static const char shared_name[] = "shared";
+#define SHARED_SIZE (256 * 1024)
+#define READ_SIZE 512
+#define READ_CNT 128
+
+/* Each child writes a file of its own in WRITE_SIZE requests... */
+#define OWN_SIZE (64 * 1024)
+#define WRITE_SIZE 4096
+
+/* ...and creates and removes SMALL_CNT small files. */
+#define SMALL_CNT 20
+
+#endif /* tests/filesys/bench/mixed.h */
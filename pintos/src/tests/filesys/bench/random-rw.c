@@ -0,0 +1,70 @@
+/* Measures reads and writes at random offsets in a 1 MB file,
+   in 512-byte and 4 kB requests, starting from a cold buffer
+   cache. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define MAX_IO 4096
+#define OP_CNT 256
+
+static const char file_name[] = "random";
+static char buf[MAX_IO];
+
+/* Performs OP_CNT IO-byte reads or writes at random IO-aligned
+   offsets in FD and reports them as NAME. */
+static void
+random_ops (int fd, size_t io, bool writing, const char *name)
+{
+  struct bench b;
+  int i;
+
+  bench_cold ();
+  bench_start (&b, name);
+  for (i = 0; i < OP_CNT; i++)
+    {
+      size_t ofs = random_ulong () % (FILE_SIZE / io) * io;
+      int retval;
+
+      seek (fd, ofs);
+      retval = writing ? write (fd, buf, io) : read (fd, buf, io);
+      if (retval != (int) io)
+        fail ("%s %zu bytes at offset %zu in \"%s\" returned %d",
+              writing ? "write" : "read", io, ofs, file_name, retval);
+    }
+  if (writing)
+    fsync (fd);
+  bench_end (&b, (long long) OP_CNT * io, OP_CNT);
+}
+
+void
+test_main (void)
+{
+  static const size_t sizes[] = {512, 4096};
+  size_t ofs, i;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    if (write (fd, buf, sizeof buf) != sizeof buf)
+      fail ("write %zu bytes at offset %zu in \"%s\"",
+            sizeof buf, ofs, file_name);
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      char name[64];
+
+      snprintf (name, sizeof name, "random-read-io%zu", sizes[i]);
+      random_ops (fd, sizes[i], false, name);
+      snprintf (name, sizeof name, "random-write-io%zu", sizes[i]);
+      random_ops (fd, sizes[i], true, name);
+    }
+  close (fd);
+}
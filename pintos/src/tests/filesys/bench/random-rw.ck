@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::bench::bench;
+check_bench (qw (random-read-io512 random-write-io512 random-read-io4096 random-write-io4096));
@@ -0,0 +1,89 @@
+/* Measures sequential writes and reads of files of several
+   sizes, in 4 kB and 512-byte requests.  Each file is written
+   and fsync'd, then read back twice: once from a cold buffer
+   cache and once warm. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAX_IO 4096
+
+static char buf[MAX_IO];
+
+/* File sizes and request sizes measured. */
+static const struct
+  {
+    size_t size;
+    size_t io;
+  }
+runs[] =
+  {
+    {4096, 4096},
+    {65536, 4096},
+    {1024 * 1024, 4096},
+    {1024 * 1024, 512},
+  };
+
+/* Reads or writes all SIZE bytes of FILE_NAME in IO-byte
+   requests and reports it as NAME. */
+static void
+transfer (const char *file_name, size_t size, size_t io, bool writing,
+          const char *name)
+{
+  struct bench b;
+  size_t ofs;
+  int ops = 0;
+  int fd;
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  bench_start (&b, name);
+  for (ofs = 0; ofs < size; ofs += io)
+    {
+      size_t cnt = size - ofs < io ? size - ofs : io;
+      int retval = writing ? write (fd, buf, cnt) : read (fd, buf, cnt);
+      if (retval != (int) cnt)
+        fail ("%s %zu bytes at offset %zu in \"%s\" returned %d",
+              writing ? "write" : "read", cnt, ofs, file_name, retval);
+      ops++;
+    }
+  if (writing)
+    fsync (fd);
+  bench_end (&b, size, ops);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  random_bytes (buf, sizeof buf);
+  for (i = 0; i < sizeof runs / sizeof *runs; i++)
+    {
+      size_t size = runs[i].size;
+      size_t io = runs[i].io;
+      char file_name[32];
+      char name[64];
+
+      snprintf (file_name, sizeof file_name, "seq-%zuk-%zu", size / 1024, io);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+
+      snprintf (name, sizeof name, "seq-write-%zuk-io%zu", size / 1024, io);
+      transfer (file_name, size, io, true, name);
+
+      bench_cold ();
+      snprintf (name, sizeof name, "seq-read-cold-%zuk-io%zu",
+                size / 1024, io);
+      transfer (file_name, size, io, false, name);
+
+      snprintf (name, sizeof name, "seq-read-warm-%zuk-io%zu",
+                size / 1024, io);
+      transfer (file_name, size, io, false, name);
+
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+}
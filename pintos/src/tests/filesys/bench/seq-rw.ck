@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::bench::bench;
+my (@names);
+foreach my $run (qw (4k-io4096 64k-io4096 1024k-io4096 1024k-io512)) {
+    push (@names, "seq-write-$run", "seq-read-cold-$run", "seq-read-warm-$run");
+}
+check_bench (@names);
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["a" x 6000],
+		"b" => ["a" x 1000 . "b" x 100 . "a" x 4900]});
+pass;
@@ -0,0 +1,48 @@
+/* Clones a file, checks that the clone reads the same, then
+   writes to the clone and checks that the original does not
+   change.  Also removes a clone, and tries cloning a missing
+   file and cloning over an existing one. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 6000
+
+static char buf[SIZE];
+static char expected[SIZE];
+
+void
+test_main (void)
+{
+  int fd;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  memset (expected, 'a', sizeof expected);
+  CHECK (write (fd, expected, sizeof expected) == sizeof expected,
+         "write \"a\"");
+  close (fd);
+
+  CHECK (clone_file ("a", "b"), "clone \"a\" to \"b\"");
+  CHECK ((fd = open ("b")) > 1, "open \"b\"");
+  CHECK (filesize (fd) == SIZE, "\"b\" is as long as \"a\"");
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"b\"");
+  CHECK (!memcmp (buf, expected, sizeof buf), "\"b\" matches \"a\"");
+
+  memset (buf, 'b', 100);
+  seek (fd, 1000);
+  CHECK (write (fd, buf, 100) == 100, "write \"b\"");
+  close (fd);
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"a\"");
+  CHECK (!memcmp (buf, expected, sizeof buf), "\"a\" is unchanged");
+  close (fd);
+
+  CHECK (clone_file ("a", "c"), "clone \"a\" to \"c\"");
+  CHECK (remove ("c"), "remove \"c\"");
+  CHECK (!clone_file ("missing", "d"), "clone missing file (must fail)");
+  CHECK (!clone_file ("a", "b"), "clone over \"b\" (must fail)");
+}
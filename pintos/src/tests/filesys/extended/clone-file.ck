@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-file) begin
+(clone-file) create "a"
+(clone-file) open "a"
+(clone-file) write "a"
+(clone-file) clone "a" to "b"
+(clone-file) open "b"
+(clone-file) "b" is as long as "a"
+(clone-file) read "b"
+(clone-file) "b" matches "a"
+(clone-file) write "b"
+(clone-file) open "a"
+(clone-file) read "a"
+(clone-file) "a" is unchanged
+(clone-file) clone "a" to "c"
+(clone-file) remove "c"
+(clone-file) clone missing file (must fail)
+(clone-file) clone over "b" (must fail)
+(clone-file) end
+EOF
+pass;
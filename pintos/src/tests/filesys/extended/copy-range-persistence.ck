@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($orig) = join ('', map (chr (ord ('a') + $_ % 26), 0...5999));
+my ($copy) = (substr ($orig, 0, 3000) . substr ($orig, 100, 200)
+	      . substr ($orig, 3200) . substr ($orig, -10));
+check_archive ({"a" => [$orig], "b" => [$copy]});
+pass;
@@ -0,0 +1,48 @@
+/* Copies a file with copy_file_range(), then copies part of it
+   into the middle of another, and checks the results.  Also
+   checks that copying stops at end of file and that overlapping
+   ranges within one file are refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 6000
+
+static char buf[SIZE];
+static char expected[SIZE];
+
+void
+test_main (void)
+{
+  int a, b;
+  size_t i;
+
+  for (i = 0; i < sizeof expected; i++)
+    expected[i] = 'a' + i % 26;
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((a = open ("a")) > 1, "open \"a\"");
+  CHECK (write (a, expected, SIZE) == SIZE, "write \"a\"");
+
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((b = open ("b")) > 1, "open \"b\"");
+  CHECK (copy_file_range (a, 0, b, 0, SIZE) == SIZE, "copy \"a\" to \"b\"");
+  CHECK (read (b, buf, SIZE) == SIZE, "read \"b\"");
+  CHECK (!memcmp (buf, expected, SIZE), "\"b\" matches \"a\"");
+
+  CHECK (copy_file_range (a, 100, b, 3000, 200) == 200,
+         "copy 200 bytes into \"b\"");
+  memcpy (expected + 3000, expected + 100, 200);
+  seek (b, 0);
+  CHECK (read (b, buf, SIZE) == SIZE, "read \"b\"");
+  CHECK (!memcmp (buf, expected, SIZE), "\"b\" has the copied range");
+
+  CHECK (copy_file_range (a, SIZE - 10, b, SIZE, 100) == 10,
+         "copy stops at end of \"a\"");
+  CHECK (filesize (b) == SIZE + 10, "\"b\" grew by 10 bytes");
+  CHECK (copy_file_range (a, 0, a, 100, 200) == -1,
+         "copy overlapping range (must fail)");
+  close (a);
+  close (b);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "a"
+(copy-range) open "a"
+(copy-range) write "a"
+(copy-range) create "b"
+(copy-range) open "b"
+(copy-range) copy "a" to "b"
+(copy-range) read "b"
+(copy-range) "b" matches "a"
+(copy-range) copy 200 bytes into "b"
+(copy-range) read "b"
+(copy-range) "b" has the copied range
+(copy-range) copy stops at end of "a"
+(copy-range) "b" grew by 10 bytes
+(copy-range) copy overlapping range (must fail)
+(copy-range) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Tests getdents(), which reads many directory entries in a
+   single call along with their inode numbers, types and sizes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct dirent entries[4];
+  int fd, cnt;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/b", 100), "create \"a/b\"");
+  CHECK (mkdir ("a/c"), "mkdir \"a/c\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+
+  cnt = getdents (fd, entries, sizeof entries);
+  CHECK (cnt == 2, "getdents \"a\" returned %d entries", cnt);
+  CHECK (!strcmp (entries[0].name, "b") && !entries[0].is_dir
+         && entries[0].size == 100, "\"b\" is a 100-byte file");
+  CHECK (!strcmp (entries[1].name, "c") && entries[1].is_dir,
+         "\"c\" is a directory");
+  CHECK (entries[0].inumber != entries[1].inumber,
+         "inumbers are distinct");
+  CHECK (getdents (fd, entries, sizeof entries) == 0,
+         "getdents \"a\" at end of directory");
+  close (fd);
+}
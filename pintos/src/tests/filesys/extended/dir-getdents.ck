@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) create "a/b"
+(dir-getdents) mkdir "a/c"
+(dir-getdents) open "a"
+(dir-getdents) getdents "a" returned 2 entries
+(dir-getdents) "b" is a 100-byte file
+(dir-getdents) "c" is a directory
+(dir-getdents) inumbers are distinct
+(dir-getdents) getdents "a" at end of directory
+(dir-getdents) end
+EOF
+pass;
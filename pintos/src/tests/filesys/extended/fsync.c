@@ -0,0 +1,34 @@
+/* Tests fsync(), which must write a file's dirty sectors back to
+   disk without evicting them from the buffer cache. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1024];
+
+void
+test_main (void)
+{
+  int fd, writes;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  memset (buf, 'x', sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+
+  writes = device_writes ();
+  CHECK (fsync (fd), "fsync \"a\"");
+  CHECK (device_writes () - writes >= 2, "fsync wrote back the data");
+
+  writes = device_writes ();
+  CHECK (fdatasync (fd), "fdatasync \"a\"");
+  CHECK (device_writes () == writes, "nothing left to write back");
+
+  buffer_stats_reset ();
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"a\"");
+  CHECK (buffer_miss_count () == 0, "cache is still warm");
+  close (fd);
+}
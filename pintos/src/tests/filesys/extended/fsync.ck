@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync) begin
+(fsync) create "a"
+(fsync) open "a"
+(fsync) write "a"
+(fsync) fsync "a"
+(fsync) fsync wrote back the data
+(fsync) fdatasync "a"
+(fsync) nothing left to write back
+(fsync) read "a"
+(fsync) cache is still warm
+(fsync) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Writes a file small enough to be stored in its inode sector,
+   then grows it past what the inode sector can hold, checking
+   its contents before and after. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1000];
+
+void
+test_main (void)
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("inline", 0), "create \"inline\"");
+  CHECK ((fd = open ("inline")) > 1, "open \"inline\"");
+  CHECK (write (fd, buf, 400) == 400, "write 400 bytes to \"inline\"");
+  seek (fd, 0);
+  check_file_handle (fd, "inline", buf, 400);
+  CHECK (write (fd, buf + 400, sizeof buf - 400) == sizeof buf - 400,
+         "grow \"inline\" to %zu bytes", sizeof buf);
+  msg ("close \"inline\"");
+  close (fd);
+  check_file ("inline", buf, sizeof buf);
+}
@@ -0,0 +1,53 @@
+/* Creates and removes enough files that their metadata fills the
+   journal's log several times over, forcing checkpoints, then
+   checks that the directory reads back correctly. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 64
+
+void
+test_main (void)
+{
+  char name[16];
+  int fd, i;
+
+  CHECK (mkdir ("j"), "mkdir \"j\"");
+
+  msg ("creating %d files in \"j\"", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "j/%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      CHECK (write (fd, name, strlen (name)) == (int) strlen (name),
+             "write \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+
+  msg ("removing even-numbered files");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "j/%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "j/%d", i);
+      fd = open (name);
+      if ((i % 2 == 0) != (fd < 0))
+        fail ("\"%s\" should %sexist", name, i % 2 == 0 ? "not " : "");
+      if (fd >= 0)
+        close (fd);
+    }
+  msg ("directory contents are correct");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal) begin
+(journal) mkdir "j"
+(journal) creating 64 files in "j"
+(journal) removing even-numbered files
+(journal) directory contents are correct
+(journal) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => ["a" x 4000 . "b" x 100 . "a" x 1900],
+		"b" => ["a" x 6000]});
+pass;
@@ -0,0 +1,42 @@
+/* Maps a two-page file, copies it to another file straight from
+   the mapping, modifies it through the mapping and checks that
+   munmap writes the change back. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define SIZE 6000
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int fd, copy;
+  mapid_t map;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  memset (buf, 'a', sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  CHECK ((map = mmap (fd, ACTUAL)) != MAP_FAILED, "mmap \"a\"");
+  CHECK (ACTUAL[SIZE - 1] == 'a' && ACTUAL[SIZE] == 0,
+         "mapping ends with the file");
+
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((copy = open ("b")) > 1, "open \"b\"");
+  CHECK (write (copy, ACTUAL, SIZE) == SIZE, "write \"b\" from mapping");
+  close (copy);
+
+  memset (ACTUAL + 4000, 'b', 100);
+  munmap (map);
+
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"a\"");
+  CHECK (buf[3999] == 'a' && buf[4000] == 'b' && buf[4099] == 'b'
+         && buf[4100] == 'a', "munmap wrote back the change");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-rw) begin
+(mmap-rw) create "a"
+(mmap-rw) open "a"
+(mmap-rw) write "a"
+(mmap-rw) mmap "a"
+(mmap-rw) mapping ends with the file
+(mmap-rw) create "b"
+(mmap-rw) open "b"
+(mmap-rw) write "b" from mapping
+(mmap-rw) read "a"
+(mmap-rw) munmap wrote back the change
+(mmap-rw) end
+EOF
+pass;
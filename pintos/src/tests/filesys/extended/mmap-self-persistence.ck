@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($page) = 4096;
+my ($data) = random_bytes (24 * $page);
+for (1..2) {
+    substr ($data, 0, 20 * $page) = substr ($data, 4 * $page, 20 * $page);
+}
+check_archive ({"big" => [$data]});
+pass;
@@ -0,0 +1,44 @@
+/* Maps a 24-page file and moves 20 pages of it with read() into
+   and write() from its own mapping, more pages than the page
+   cache lets one process keep mapped, then checks the result. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE 4096
+#define SIZE (24 * PAGE)
+#define SHIFT (4 * PAGE)
+#define COPY (SIZE - SHIFT)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int fd;
+  mapid_t map;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("big", 0), "create \"big\"");
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"big\"");
+  CHECK ((map = mmap (fd, ACTUAL)) != MAP_FAILED, "mmap \"big\"");
+
+  seek (fd, SHIFT);
+  CHECK (read (fd, ACTUAL, COPY) == COPY, "read \"big\" into its mapping");
+  memmove (buf, buf + SHIFT, COPY);
+
+  seek (fd, 0);
+  CHECK (write (fd, ACTUAL + SHIFT, COPY) == COPY,
+         "write \"big\" from its mapping");
+  memmove (buf, buf + SHIFT, COPY);
+
+  munmap (map);
+  msg ("close \"big\"");
+  close (fd);
+  check_file ("big", buf, sizeof buf);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-self) begin
+(mmap-self) create "big"
+(mmap-self) open "big"
+(mmap-self) write "big"
+(mmap-self) mmap "big"
+(mmap-self) read "big" into its mapping
+(mmap-self) write "big" from its mapping
+(mmap-self) close "big"
+(mmap-self) open "big" for verification
+(mmap-self) verified contents of "big"
+(mmap-self) close "big"
+(mmap-self) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Tests stat() and fstat(), which report a file's size, type and
+   inode number without needing an open file for stat(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct stat st, fst;
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/b", 1234), "create \"a/b\"");
+  CHECK (stat ("a/b", &st), "stat \"a/b\"");
+  CHECK (!st.is_dir && st.size == 1234, "\"a/b\" is a 1234-byte file");
+  CHECK (stat ("a", &st), "stat \"a\"");
+  CHECK (st.is_dir, "\"a\" is a directory");
+  CHECK (!stat ("a/c", &st), "stat \"a/c\" (must fail)");
+
+  CHECK ((fd = open ("a/b")) > 1, "open \"a/b\"");
+  CHECK (fstat (fd, &fst), "fstat \"a/b\"");
+  CHECK (stat ("a/b", &st), "stat \"a/b\"");
+  CHECK (fst.inumber == inumber (fd) && st.inumber == fst.inumber,
+         "inumbers match");
+  close (fd);
+}
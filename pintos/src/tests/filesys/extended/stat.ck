@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(stat) begin
+(stat) mkdir "a"
+(stat) create "a/b"
+(stat) stat "a/b"
+(stat) "a/b" is a 1234-byte file
+(stat) stat "a"
+(stat) "a" is a directory
+(stat) stat "a/c" (must fail)
+(stat) open "a/b"
+(stat) fstat "a/b"
+(stat) stat "a/b"
+(stat) inumbers match
+(stat) end
+EOF
+pass;
@@ -34,6 +34,9 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/iotrace.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -49,6 +52,17 @@ static bool format_filesys;
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -ramdisk: Size of the RAM disk in kB, or 0 for none. */
+static size_t ramdisk_kb;
+
+/* -iotrace: Number of block I/O events to trace, or 0 for none. */
+static size_t iotrace_events;
+
+/* -stripe, -stripe-unit: Block devices to stripe the file system
+   across, if any, and the number of sectors in a stripe unit. */
+static char *stripe_members;
+static unsigned stripe_sectors = 64;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -123,7 +137,17 @@ main (void)
 
 #ifdef FILESYS
   /* Initialize file system. */
+  if (iotrace_events > 0)
+    iotrace_init (iotrace_events);
   ide_init ();
+  if (ramdisk_kb > 0)
+    ramdisk_init (ramdisk_kb);
+  if (stripe_members != NULL)
+    {
+      stripe_init (stripe_members, stripe_sectors);
+      if (filesys_bdev_name == NULL)
+        filesys_bdev_name = "md0";
+    }
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -245,10 +269,20 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-bs"))
+        filesys_set_block_size (atoi (value));
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
+      else if (!strcmp (name, "-iotrace"))
+        iotrace_events = atoi (value);
+      else if (!strcmp (name, "-stripe"))
+        stripe_members = value;
+      else if (!strcmp (name, "-stripe-unit"))
+        stripe_sectors = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -373,8 +407,13 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -bs=BYTES          Format with BYTES-byte blocks (512 to 4096).\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=KB        Create a KB-kB RAM disk named rd0.\n"
+          "  -iotrace=EVENTS    Trace block I/O, dumping it to scratch.\n"
+          "  -stripe=BDEV,...   Use BDEVs striped together for file system.\n"
+          "  -stripe-unit=N     Stripe in units of N sectors (default 64).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
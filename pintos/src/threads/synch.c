@@ -339,3 +339,99 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  A readers-writer lock may be held by any
+   number of readers at once, or by a single writer.  Waiting
+   writers are preferred over new readers so that a steady stream
+   of readers cannot starve a writer.
+
+   Like locks, readers-writer locks are not recursive: a thread
+   that holds RWLOCK in either mode must not acquire it again. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->can_read);
+  cond_init (&rwlock->can_write);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rwlock->writer != thread_current ());
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->waiting_writers > 0)
+    cond_wait (&rwlock->can_read, &rwlock->lock);
+  rwlock->readers++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases a read hold on RWLOCK, letting a waiting writer in
+   if this was the last reader. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock->readers > 0);
+
+  lock_acquire (&rwlock->lock);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->can_write, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or
+   writer holds it. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writer != NULL || rwlock->readers > 0)
+    cond_wait (&rwlock->can_write, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writer = thread_current ();
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which must be held for writing by the current
+   thread.  Hands it to the next writer if there is one, otherwise
+   to every waiting reader. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->writer = NULL;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->can_write, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->can_read, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
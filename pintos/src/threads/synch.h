@@ -41,6 +41,24 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the fields below. */
+    struct condition can_read;  /* Signaled when readers may enter. */
+    struct condition can_write; /* Signaled when a writer may enter. */
+    unsigned readers;           /* Number of threads holding it shared. */
+    unsigned waiting_writers;   /* Number of writers waiting to enter. */
+    struct thread *writer;      /* Thread holding it exclusively, if any. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -498,6 +498,11 @@ init_thread (struct thread *t, const char *name, int priority)
 
   // Initialize this thread's Pintos list of child wait statuses.
   list_init(&(t->o_children_wait_status_list)); //mabel, Do list init
+#ifdef USERPROG
+  list_init (&t->mappings);
+  list_init (&t->mapped_pages);
+  t->pin_start = t->pin_end = NULL;
+#endif
   /* End allocations */
 
   old_level = intr_disable ();
@@ -105,6 +105,9 @@ struct thread
     /* Project 3 Task 3*/
     struct dir *cwd;
 
+    /* Owned by devices/iotrace.c. */
+    uint8_t io_kind;                    /* Kind of block access being made. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -112,6 +115,13 @@ struct thread
     /* Pintos list of this thread's children's wait statuses. */
     struct list o_children_wait_status_list; 
 
+    /* Owned by userprog/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    struct list mapped_pages;           /* Their present pages, oldest first. */
+    const uint8_t *pin_start;           /* Mapped pages from PIN_START */
+    const uint8_t *pin_end;             /* up to PIN_END stay present. */
+    int next_mapid;                     /* Identifier for the next mapping. */
+
 #endif
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
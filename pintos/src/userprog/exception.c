@@ -2,6 +2,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/mmap.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
@@ -155,9 +156,12 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+  /* Bring in pages of memory-mapped files on first access,
+     whether by the process itself or by the kernel on its
+     behalf. */
+  if (not_present && mmap_load (fault_addr))
+    return;
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
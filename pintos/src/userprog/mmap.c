@@ -0,0 +1,303 @@
+#include "userprog/mmap.h"
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "filesys/page-cache.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Memory-mapped files.
+
+   A mapping reserves a run of user pages, one for each page of
+   the file, but reads nothing when it is created.  The first
+   access to each page faults, and page_fault() calls mmap_load()
+   to map in the frame that holds that page of the file in the
+   page cache, the same frame read() and write() use.  When the
+   mapping goes away, whether by munmap or by process exit, pages
+   the process wrote to, as recorded by the dirty bit in its page
+   table, are marked dirty in the page cache, which writes them
+   back in due course.
+
+   A mapped page stays in memory from its first access until the
+   mapping is removed, unless the page cache has as many mapped
+   pages as it allows, or runs out of frames, in which case the
+   process gives up the oldest of its own mapped pages.  Pages
+   pinned by a system call for its user buffer are never given
+   up, since the call copies to or from them while holding file
+   system locks that a page fault would need again.  Mappings are
+   private to their process and only touched by its own thread,
+   so they need no locking. */
+
+/* A memory-mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's mappings. */
+    int mapid;                  /* Mapping identifier. */
+    struct file *file;          /* Mapped file, reopened. */
+    uint8_t *base;              /* First user page. */
+    off_t length;               /* File length when mapped. */
+  };
+
+/* A present page of a mapping. */
+struct mapped_page
+  {
+    struct list_elem elem;      /* Element in thread's mapped_pages. */
+    struct mapping *m;          /* Mapping it belongs to. */
+    size_t page;                /* Index of the page in M. */
+  };
+
+/* Returns the number of pages M spans. */
+static size_t
+page_cnt (const struct mapping *m)
+{
+  return DIV_ROUND_UP (m->length, PGSIZE);
+}
+
+/* Returns the current process's mapping that contains user
+   address ADDR, or a null pointer if there is none. */
+static struct mapping *
+find_by_addr (const void *addr)
+{
+  struct thread *t = thread_current ();
+  const uint8_t *a = addr;
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (a >= m->base && a < m->base + page_cnt (m) * PGSIZE)
+        return m;
+    }
+  return NULL;
+}
+
+/* Returns the current process's mapping with identifier MAPID,
+   or a null pointer if there is none. */
+static struct mapping *
+find_by_id (int mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->mapid == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Maps FILE into the current process's address space starting
+   at page-aligned user address ADDR.  Returns the new mapping's
+   identifier, or -1 if FILE is empty, the pages it would occupy
+   are not all free, or its data could not be given sectors of
+   its own. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  length = file_length (file);
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0)
+    return -1;
+
+  for (i = 0; i < (size_t) DIV_ROUND_UP (length, PGSIZE); i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+      if (!is_user_vaddr (upage)
+          || pagedir_get_page (t->pagedir, upage) != NULL
+          || find_by_addr (upage) != NULL)
+        return -1;
+    }
+
+  if (!inode_prepare_map (file_get_inode (file)))
+    return -1;
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return -1;
+    }
+  m->mapid = t->next_mapid++;
+  m->base = addr;
+  m->length = length;
+  list_push_back (&t->mappings, &m->elem);
+  return m->mapid;
+}
+
+/* Unmaps page I of M from the current process, if it is present,
+   and hands it back to the page cache.  Returns true if it was
+   present. */
+static bool
+unmap_page (struct mapping *m, size_t i)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = m->base + i * PGSIZE;
+  struct list_elem *e;
+  bool dirty;
+
+  if (pagedir_get_page (t->pagedir, upage) == NULL)
+    return false;
+  dirty = pagedir_is_dirty (t->pagedir, upage);
+  pagedir_clear_page (t->pagedir, upage);
+  inode_unmap_page (file_get_inode (m->file), i * PGSIZE, dirty);
+
+  for (e = list_begin (&t->mapped_pages); e != list_end (&t->mapped_pages);
+       e = list_next (e))
+    {
+      struct mapped_page *mp = list_entry (e, struct mapped_page, elem);
+      if (mp->m == m && mp->page == i)
+        {
+          list_remove (e);
+          free (mp);
+          break;
+        }
+    }
+  return true;
+}
+
+/* Gives back the oldest of the current process's mapped pages
+   that is not pinned, to make room in the page cache.  Returns
+   false if it has none. */
+static bool
+release_page (void)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mapped_pages); e != list_end (&t->mapped_pages);
+       e = list_next (e))
+    {
+      struct mapped_page *mp = list_entry (e, struct mapped_page, elem);
+      uint8_t *upage = mp->m->base + mp->page * PGSIZE;
+      if (upage < t->pin_start || upage >= t->pin_end)
+        return unmap_page (mp->m, mp->page);
+    }
+  return false;
+}
+
+/* Hands the pages of M back to the page cache and closes its
+   file. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt (m); i++)
+    unmap_page (m, i);
+  list_remove (&m->elem);
+  file_close (m->file);
+  free (m);
+}
+
+/* Removes the current process's mapping MAPID.  Returns false if
+   there is no such mapping. */
+bool
+mmap_unmap (int mapid)
+{
+  struct mapping *m = find_by_id (mapid);
+
+  if (m == NULL)
+    return false;
+  unmap (m);
+  return true;
+}
+
+/* Removes all of the current process's mappings.  Must be called
+   before its page directory is destroyed. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
+
+/* Brings in the page of a memory-mapped file that contains user
+   address ADDR, if it is not present.  Returns true if the page
+   is now present, false if ADDR is not in a mapping or the page
+   cache has no frame for it. */
+bool
+mmap_load (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  uint8_t *upage = pg_round_down (addr);
+  struct mapped_page *mp;
+  uint8_t *kpage;
+  off_t ofs;
+
+  if (!is_user_vaddr (addr) || t->pagedir == NULL)
+    return false;
+  if (pagedir_get_page (t->pagedir, upage) != NULL)
+    return true;
+  m = find_by_addr (addr);
+  if (m == NULL)
+    return false;
+
+  mp = malloc (sizeof *mp);
+  if (mp == NULL)
+    return false;
+
+  /* Leave the page cache unmapped frames for reads and writes. */
+  while (page_cache_map_full () && release_page ())
+    continue;
+
+  ofs = upage - m->base;
+  while ((kpage = inode_map_page (file_get_inode (m->file), ofs)) == NULL)
+    if (!release_page ())
+      {
+        free (mp);
+        return false;
+      }
+
+  if (!pagedir_set_page (t->pagedir, upage, kpage, true))
+    {
+      inode_unmap_page (file_get_inode (m->file), ofs, false);
+      free (mp);
+      return false;
+    }
+  mp->m = m;
+  mp->page = ofs / PGSIZE;
+  list_push_back (&t->mapped_pages, &mp->elem);
+  return true;
+}
+
+/* Keeps the current process's mapped pages that hold any of the
+   SIZE bytes at user address ADDR present until mmap_unpin() is
+   called.  A system call pins its user buffer before checking it
+   a page at a time, so that bringing in its later pages can't
+   give back its earlier ones. */
+void
+mmap_pin (const void *addr, size_t size)
+{
+  struct thread *t = thread_current ();
+  const uint8_t *start = addr;
+
+  t->pin_start = pg_round_down (addr);
+  t->pin_end = (start < (uint8_t *) PHYS_BASE
+                && size < (size_t) ((uint8_t *) PHYS_BASE - start)
+                ? start + size : (uint8_t *) PHYS_BASE);
+}
+
+/* Lets the pages pinned by mmap_pin() be given back again. */
+void
+mmap_unpin (void)
+{
+  struct thread *t = thread_current ();
+
+  t->pin_start = t->pin_end = NULL;
+}
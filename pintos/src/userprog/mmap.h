@@ -0,0 +1,15 @@
+#ifndef USERPROG_MMAP_H
+#define USERPROG_MMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/file.h"
+
+int mmap_map (struct file *, void *addr);
+bool mmap_unmap (int mapid);
+void mmap_unmap_all (void);
+bool mmap_load (const void *addr);
+void mmap_pin (const void *addr, size_t size);
+void mmap_unpin (void);
+
+#endif /* userprog/mmap.h */
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/mmap.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
@@ -229,6 +230,10 @@ process_exit (void)
     }
   }
 
+  /* Write back and remove memory-mapped files while their pages
+     are still mapped. */
+  mmap_unmap_all ();
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
+#include <limits.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <string.h>
@@ -11,20 +12,25 @@
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/page-cache.h"
 #include "filesys/directory.h"
 #include "devices/input.h"
 #include "devices/block.h"
+#include "devices/timer.h"
 
 #include "threads/vaddr.h"
 #include "devices/shutdown.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/mmap.h"
 
 #include "filesys/directory.h"
 #include "threads/malloc.h"
 
 
 static void syscall_handler (struct intr_frame *);
+static void syscall_dispatch (struct intr_frame *);
 struct lock file_lock;
 extern g_filesys_malloc;
 extern int g_buffer_misses, g_buffer_accesses;
@@ -38,6 +44,7 @@ syscall_init (void)
 
 /**
 * Checks VADDR is not NULL, is in userspace, and is mapped.
+* Pages of memory-mapped files are brought in as needed.
 */
 static bool
 is_valid(const void *vaddr, struct thread *t) {
@@ -47,7 +54,7 @@ is_valid(const void *vaddr, struct thread *t) {
   if (!is_user_vaddr(vaddr)) {
     return false;
   }
-  if (pagedir_get_page(t->pagedir, vaddr) == NULL) {
+  if (pagedir_get_page(t->pagedir, vaddr) == NULL && !mmap_load(vaddr)) {
     return false;
   }
   return true;
@@ -71,11 +78,15 @@ is_valid_string(char *string, struct thread *t) {
 
 /**
 * Checks buffer has valid address for each element.
+* Mapped pages of the buffer stay present until the system call returns.
 * Returns true if valid, false if invalid.
 */
 static bool
 is_valid_buffer(char *buffer, int size, struct thread *t) {
   int n = 0;
+  if (size > 0) {
+    mmap_pin(buffer, size);
+  }
   for (; n < size; n ++) {
     if (!is_valid((void *) buffer + n, t)) {
       return false;
@@ -92,8 +103,25 @@ is_valid_fd(int fd, struct thread *t) {
   return !(fd < 2 || fd > 127 || t->file_descriptors[fd] == NULL);
 }
 
+/**
+* Fills ST with the metadata of INODE.
+*/
+static void
+fill_stat(struct inode *inode, struct stat *st) {
+  st->inumber = inode_get_inumber(inode);
+  st->size = inode_length(inode);
+  st->is_dir = inode_is_dir(inode);
+}
+
+static void
+syscall_handler (struct intr_frame *f)
+{
+  syscall_dispatch(f);
+  mmap_unpin();
+}
+
 static void
-syscall_handler (struct intr_frame *f UNUSED)
+syscall_dispatch (struct intr_frame *f UNUSED)
 {
   uint32_t* args = ((uint32_t*) f->esp);
   struct thread *cur = thread_current();
@@ -569,6 +597,190 @@ syscall_handler (struct intr_frame *f UNUSED)
 
   }
 
+  if (args[0] == SYS_GETDENTS) {
+    /* Check if &args[1], &args[2], &args[3] are valid.*/
+    if (!is_valid((void *) args + 1, cur) || !is_valid((void *) args + 2, cur) || !is_valid((void *) args + 3, cur)) {
+      exit_with_code(-1);
+    }
+    /* Check if args[2] is valid and is not a null pointer. */
+    if (!is_valid((void *) args[2], cur) || args[2] == 0) {
+      exit_with_code(-1);
+    }
+    /* Only whole records are filled in, so only their bytes are
+       checked, and a size too large for an int is refused before it
+       can turn negative and skip the check. */
+    if (args[3] > INT_MAX) {
+      f->eax = -1;
+      return;
+    }
+    unsigned cnt = args[3] / sizeof (struct dirent);
+    /* Check if the buffer is valid. */
+    if (!is_valid_buffer((char *) args[2], cnt * sizeof (struct dirent), cur)) {
+      f->eax = -1;
+      return;
+    }
+    /* Check if fd is valid and refers to a directory. */
+    int fd = args[1];
+    if (!is_valid_fd(fd, cur) || cur->file_descriptors[fd]->dir == NULL) {
+      f->eax = -1;
+      return;
+    }
+
+    /* Fill in as many whole records as fit in the buffer. */
+    struct dir *dir = cur->file_descriptors[fd]->dir;
+    struct dirent *entries = (struct dirent *) args[2];
+    unsigned i = 0;
+    for (; i < cnt; i ++) {
+      block_sector_t inumber;
+      bool is_dir;
+      off_t length;
+      if (!dir_readdir_stat(dir, entries[i].name, &inumber, &is_dir, &length)) {
+        break;
+      }
+      entries[i].inumber = inumber;
+      entries[i].is_dir = is_dir;
+      entries[i].size = length;
+    }
+    f->eax = i;
+    return;
+  }
+
+  if (args[0] == SYS_STAT) {
+    /* Check if &args[1], &args[2] are valid. */
+    if (!is_valid((void *) args + 1, cur) || !is_valid((void *) args + 2, cur)) {
+      exit_with_code(-1);
+    }
+    /* Check if args[1] is valid and is not a null pointer. */
+    if (!is_valid((void *) args[1], cur) || args[1] == 0) {
+      exit_with_code(-1);
+    }
+    /* Check if the stat buffer is valid. */
+    if (!is_valid_buffer((char *) args[2], sizeof (struct stat), cur)) {
+      f->eax = false;
+      return;
+    }
+    /* Check every character in args[1] has a valid address until the null terminator. */
+    int n = is_valid_string((char *) args[1], cur);
+    if (n < 0 || n == 0 || n > PATH_MAX) {
+      f->eax = false;
+      return;
+    }
+    /* Copy over args[1]. */
+    char file_name[n + 1];
+    memcpy((char *) file_name, (char *) args[1], n + 1);
+
+    /* Answer straight from the inode; no file or fd is allocated. */
+    struct inode *inode = get_inode_from_path(file_name);
+    if (inode == NULL) {
+      f->eax = false;
+      return;
+    }
+    fill_stat(inode, (struct stat *) args[2]);
+    inode_close(inode);
+    f->eax = true;
+    return;
+  }
+
+  if (args[0] == SYS_CLONE_FILE) {
+    /* Check if &args[1], &args[2] are valid. */
+    if (!is_valid((void *) args + 1, cur) || !is_valid((void *) args + 2, cur)) {
+      exit_with_code(-1);
+    }
+    /* Check if args[1] and args[2] are valid and are not null pointers. */
+    if (!is_valid((void *) args[1], cur) || args[1] == 0
+        || !is_valid((void *) args[2], cur) || args[2] == 0) {
+      exit_with_code(-1);
+    }
+    /* Check every character of both names has a valid address until the null terminator. */
+    int n = is_valid_string((char *) args[1], cur);
+    int m = is_valid_string((char *) args[2], cur);
+    if (n <= 0 || n > PATH_MAX || m <= 0 || m > PATH_MAX) {
+      f->eax = false;
+      return;
+    }
+    /* Copy over args[1] and args[2]. */
+    char src[n + 1], dst[m + 1];
+    memcpy((char *) src, (char *) args[1], n + 1);
+    memcpy((char *) dst, (char *) args[2], m + 1);
+    f->eax = filesys_clone(src, dst);
+    return;
+  }
+
+  if (args[0] == SYS_COPY_FILE_RANGE) {
+    /* Check if &args[1] through &args[5] are valid. */
+    int i;
+    for (i = 1; i <= 5; i ++) {
+      if (!is_valid((void *) (args + i), cur)) {
+        exit_with_code(-1);
+      }
+    }
+    /* Check if both fds are valid and refer to files. */
+    int in_fd = args[1], out_fd = args[3];
+    if (!is_valid_fd(in_fd, cur) || !is_valid_fd(out_fd, cur)
+        || cur->file_descriptors[in_fd]->file == NULL
+        || cur->file_descriptors[out_fd]->file == NULL) {
+      f->eax = -1;
+      return;
+    }
+    /* Offsets and size must fit in an off_t. */
+    off_t in_ofs = args[2], out_ofs = args[4], size = args[5];
+    if (in_ofs < 0 || out_ofs < 0 || size < 0) {
+      f->eax = -1;
+      return;
+    }
+    /* The data never passes through user memory. */
+    f->eax = file_copy_range(cur->file_descriptors[in_fd]->file, in_ofs,
+                             cur->file_descriptors[out_fd]->file, out_ofs, size);
+    return;
+  }
+
+  if (args[0] == SYS_FSTAT) {
+    /* Check if &args[1], &args[2] are valid. */
+    if (!is_valid((void *) args + 1, cur) || !is_valid((void *) args + 2, cur)) {
+      exit_with_code(-1);
+    }
+    /* Check if the stat buffer is valid. */
+    if (!is_valid_buffer((char *) args[2], sizeof (struct stat), cur)) {
+      f->eax = false;
+      return;
+    }
+    /* Check if fd is valid. */
+    int fd = args[1];
+    if (!is_valid_fd(fd, cur)) {
+      f->eax = false;
+      return;
+    }
+    struct fd *my_fd = cur->file_descriptors[fd];
+    if (my_fd->dir != NULL) {
+      fill_stat(dir_get_inode(my_fd->dir), (struct stat *) args[2]);
+    } else {
+      fill_stat(file_get_inode(my_fd->file), (struct stat *) args[2]);
+    }
+    f->eax = true;
+    return;
+  }
+
+  if (args[0] == SYS_FSYNC || args[0] == SYS_FDATASYNC) {
+    /* Check if &args[1] is valid.*/
+    if (!is_valid((void *) args + 1, cur)) {
+      exit_with_code(-1);
+    }
+    /* Check if fd is valid. */
+    int fd = args[1];
+    if (!is_valid_fd(fd, cur)) {
+      f->eax = false;
+      return;
+    }
+    /* Write back only this inode's dirty sectors; the rest of the
+       cache stays warm. */
+    struct fd *my_fd = cur->file_descriptors[fd];
+    struct inode *inode = my_fd->dir != NULL ? dir_get_inode(my_fd->dir)
+                                             : file_get_inode(my_fd->file);
+    inode_sync(inode, args[0] == SYS_FDATASYNC);
+    f->eax = true;
+    return;
+  }
+
   if (args[0] == SYS_ISDIR) {
     /* Check if &args[1] is valid.*/
     if (!is_valid((void *) args + 1, cur)) {
@@ -640,6 +852,8 @@ syscall_handler (struct intr_frame *f UNUSED)
     return;
   }
   if (args[0] == SYS_BUFRESET) {
+    page_cache_flush_all ();
+    journal_commit ();
     flush_buffer_cache ();
     return;
   }
@@ -653,4 +867,30 @@ syscall_handler (struct intr_frame *f UNUSED)
     f->eax = (uint32_t) get_read_cnt (block);
     return;
   }
+  if (args[0] == SYS_MMAP) {
+    /* Check if &args[1], &args[2] are valid. */
+    if (!is_valid((void *) args + 1, cur) || !is_valid((void *) args + 2, cur)) {
+      exit_with_code(-1);
+    }
+    /* Only files can be mapped. */
+    int fd = args[1];
+    if (!is_valid_fd(fd, cur) || cur->file_descriptors[fd]->file == NULL) {
+      f->eax = -1;
+      return;
+    }
+    f->eax = mmap_map(cur->file_descriptors[fd]->file, (void *) args[2]);
+    return;
+  }
+  if (args[0] == SYS_MUNMAP) {
+    /* Check if &args[1] is valid. */
+    if (!is_valid((void *) args + 1, cur)) {
+      exit_with_code(-1);
+    }
+    mmap_unmap(args[1]);
+    return;
+  }
+  if (args[0] == SYS_TICKS) {
+    f->eax = (uint32_t) timer_ticks ();
+    return;
+  }
 }
@@ -0,0 +1,514 @@
+/* Host-side analyzer for Pintos block I/O traces.
+
+   A kernel run with "-iotrace=EVENTS" records block device
+   accesses and buffer and page cache lookups, and dumps them to
+   the scratch device at shutdown.  This tool finds the dump in a
+   copy of that disk and reports where the accesses went, how
+   sequential they were, how soon sectors were reused, and what
+   hit rate other cache sizes and replacement policies would have
+   had on the same lookups.  The dump format comes from
+   devices/iotrace-format.h, which the kernel uses too. */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/iotrace-format.h"
+
+#define SECTOR_SIZE 512
+
+static const char *program_name;
+
+static struct iotrace_header header;
+static struct iotrace_event *events;
+
+static const char *op_names[IOTRACE_OP_CNT] =
+  { "read", "write", "hit", "miss" };
+static const char *kind_names[IOTRACE_KIND_CNT] =
+  { "other", "data", "inode", "index", "dir", "bitmap", "journal", "meta" };
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "iotrace: analyzes Pintos block I/O traces\n"
+           "usage: %s [-b BUCKETS] [-c SIZE,...] [-k KIND] DISK\n"
+           "  DISK is a copy of the scratch disk of a run with\n"
+           "  \"-iotrace=EVENTS\"; the dump is found anywhere in it.\n"
+           "  -b BUCKETS   rows in each device's heat map (default 32)\n"
+           "  -c SIZE,...  cache sizes in sectors to replay (default\n"
+           "               16,32,64,128,256,512)\n"
+           "  -k KIND      replay only cache lookups of KIND: all,\n"
+           "               data, meta or one of the event kinds\n"
+           "               (default all)\n",
+           program_name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+fatal (const char *format, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", program_name);
+  va_start (args, format);
+  vfprintf (stderr, format, args);
+  va_end (args);
+  putc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+static void *
+xcalloc (size_t n, size_t size)
+{
+  void *p = calloc (n, size);
+  if (p == NULL && n * size != 0)
+    fatal ("out of memory");
+  return p;
+}
+
+/* Returns the name of device DEV. */
+static const char *
+dev_name (unsigned dev)
+{
+  static char name[17];
+
+  if (dev >= header.dev_cnt || dev >= IOTRACE_DEVS)
+    return "?";
+  memcpy (name, header.dev_names[dev], 16);
+  name[16] = '\0';
+  return name;
+}
+
+/* Reads the dump from the disk image in FILE_NAME. */
+static void
+load (const char *file_name)
+{
+  FILE *file = fopen (file_name, "rb");
+  uint8_t sector[SECTOR_SIZE];
+  long pos;
+
+  if (file == NULL)
+    fatal ("%s: %s", file_name, strerror (errno));
+
+  /* Find the header, which starts a sector. */
+  for (pos = 0; ; pos++)
+    {
+      if (fread (sector, SECTOR_SIZE, 1, file) != 1)
+        fatal ("%s: no trace found", file_name);
+      memcpy (&header, sector, sizeof header);
+      if (header.magic == IOTRACE_MAGIC)
+        break;
+    }
+
+  events = xcalloc (header.event_cnt, sizeof *events);
+  if (fread (events, sizeof *events, header.event_cnt, file)
+      != header.event_cnt)
+    fatal ("%s: trace at sector %ld is truncated", file_name, pos);
+  fclose (file);
+
+  printf ("Trace at sector %ld: %"PRIu32" events", pos, header.event_cnt);
+  if (header.lost_cnt > 0)
+    printf (", %"PRIu32" older events lost", header.lost_cnt);
+  if (header.event_cnt > 0 && header.timer_freq > 0)
+    printf (", %.2f s", (double) (events[header.event_cnt - 1].ticks
+                                  - events[0].ticks) / header.timer_freq);
+  printf ("\n\n");
+}
+
+/* Prints the number of events and sectors of each op and kind. */
+static void
+print_summary (void)
+{
+  unsigned long cnt[IOTRACE_OP_CNT][IOTRACE_KIND_CNT];
+  unsigned long sectors[IOTRACE_OP_CNT][IOTRACE_KIND_CNT];
+  uint32_t i;
+  int op, kind;
+
+  memset (cnt, 0, sizeof cnt);
+  memset (sectors, 0, sizeof sectors);
+  for (i = 0; i < header.event_cnt; i++)
+    if (events[i].op < IOTRACE_OP_CNT && events[i].kind < IOTRACE_KIND_CNT)
+      {
+        cnt[events[i].op][events[i].kind]++;
+        sectors[events[i].op][events[i].kind] += events[i].cnt;
+      }
+
+  printf ("Events (sectors) by kind:\n%-8s", "");
+  for (op = 0; op < IOTRACE_OP_CNT; op++)
+    printf (" %17s", op_names[op]);
+  printf ("\n");
+  for (kind = 0; kind < IOTRACE_KIND_CNT; kind++)
+    {
+      printf ("%-8s", kind_names[kind]);
+      for (op = 0; op < IOTRACE_OP_CNT; op++)
+        printf (" %8lu (%6lu)", cnt[op][kind], sectors[op][kind]);
+      printf ("\n");
+    }
+  printf ("\n");
+}
+
+/* Returns true if E is a device transfer, as opposed to a cache
+   lookup. */
+static bool
+is_transfer (const struct iotrace_event *e)
+{
+  return e->op == IOTRACE_READ || e->op == IOTRACE_WRITE;
+}
+
+/* Prints a heat map of the sectors transferred to and from
+   device DEV, in BUCKETS rows. */
+static void
+print_heat_map (unsigned dev, int buckets)
+{
+  unsigned long *reads = xcalloc (buckets, sizeof *reads);
+  unsigned long *writes = xcalloc (buckets, sizeof *writes);
+  unsigned long most = 0;
+  uint32_t lo = UINT32_MAX, hi = 0, span, i;
+  int b;
+
+  for (i = 0; i < header.event_cnt; i++)
+    if (events[i].dev == dev && is_transfer (&events[i]))
+      {
+        if (events[i].sector < lo)
+          lo = events[i].sector;
+        if (events[i].sector + events[i].cnt > hi)
+          hi = events[i].sector + events[i].cnt;
+      }
+  if (lo >= hi)
+    goto done;
+  span = (hi - lo + buckets - 1) / buckets;
+
+  for (i = 0; i < header.event_cnt; i++)
+    if (events[i].dev == dev && is_transfer (&events[i]))
+      {
+        b = (events[i].sector - lo) / span;
+        if (events[i].op == IOTRACE_READ)
+          reads[b] += events[i].cnt;
+        else
+          writes[b] += events[i].cnt;
+      }
+  for (b = 0; b < buckets; b++)
+    if (reads[b] + writes[b] > most)
+      most = reads[b] + writes[b];
+
+  printf ("Heat map of %s, sectors %"PRIu32" to %"PRIu32
+          " (r = read, w = written):\n", dev_name (dev), lo, hi - 1);
+  for (b = 0; b < buckets; b++)
+    {
+      int r = most > 0 ? (reads[b] * 50 + most - 1) / most : 0;
+      int w = most > 0 ? (writes[b] * 50 + most - 1) / most : 0;
+
+      printf ("%10"PRIu32" %8lu %8lu |", lo + b * span, reads[b], writes[b]);
+      while (r-- > 0)
+        putchar ('r');
+      while (w-- > 0)
+        putchar ('w');
+      putchar ('\n');
+    }
+  printf ("\n");
+
+done:
+  free (reads);
+  free (writes);
+}
+
+/* Returns the log2 bucket of N, for N >= 1. */
+static int
+log2_bucket (unsigned long n)
+{
+  int b = 0;
+
+  while (n > 1)
+    {
+      n >>= 1;
+      b++;
+    }
+  return b;
+}
+
+/* Prints a histogram of log2 buckets HIST[0...CNT - 1], whose
+   bucket B counts values from 2**B to 2**(B + 1) - 1. */
+static void
+print_histogram (const unsigned long *hist, int cnt)
+{
+  unsigned long total = 0;
+  int b;
+
+  for (b = 0; b < cnt; b++)
+    total += hist[b];
+  for (b = 0; b < cnt; b++)
+    if (hist[b] > 0)
+      printf ("  %8lu-%-8lu %8lu %5.1f%%\n", 1ul << b, (2ul << b) - 1,
+              hist[b], 100.0 * hist[b] / total);
+}
+
+/* Prints how sequential the transfers to and from device DEV
+   were: the share that began where the previous one ended, and
+   the lengths in sectors of sequential runs. */
+static void
+print_sequentiality (unsigned dev)
+{
+  unsigned long hist[33];
+  unsigned long transfers = 0, sequential = 0, sectors = 0, run = 0;
+  uint32_t next = UINT32_MAX, i;
+
+  memset (hist, 0, sizeof hist);
+  for (i = 0; i < header.event_cnt; i++)
+    {
+      const struct iotrace_event *e = &events[i];
+
+      if (e->dev != dev || !is_transfer (e))
+        continue;
+      transfers++;
+      sectors += e->cnt;
+      if (e->sector == next)
+        {
+          sequential++;
+          run += e->cnt;
+        }
+      else
+        {
+          if (run > 0)
+            hist[log2_bucket (run)]++;
+          run = e->cnt;
+        }
+      next = e->sector + e->cnt;
+    }
+  if (run > 0)
+    hist[log2_bucket (run)]++;
+  if (transfers == 0)
+    return;
+
+  printf ("Sequentiality of %s: %lu transfers of %.1f sectors on average, "
+          "%.1f%% sequential\nSequential run lengths in sectors:\n",
+          dev_name (dev), transfers, (double) sectors / transfers,
+          100.0 * sequential / transfers);
+  print_histogram (hist, 33);
+  printf ("\n");
+}
+
+/* Cache lookups to analyze. */
+static int lookup_kind = -1;            /* Kind, or -1 for all. */
+static bool lookup_meta;                /* Only metadata kinds? */
+
+/* Returns true if E is a cache lookup chosen by -k. */
+static bool
+is_lookup (const struct iotrace_event *e)
+{
+  if (e->op != IOTRACE_HIT && e->op != IOTRACE_MISS)
+    return false;
+  if (lookup_meta)
+    return e->kind != IOTRACE_DATA;
+  return lookup_kind < 0 || e->kind == lookup_kind;
+}
+
+/* Returns a key for the sector looked up by E. */
+static uint64_t
+lookup_key (const struct iotrace_event *e)
+{
+  return (uint64_t) e->dev << 32 | e->sector;
+}
+
+/* Prints the reuse distances of the chosen cache lookups: for
+   each lookup of a sector seen before, the number of other
+   sectors looked up since.  Stores each lookup's distance in
+   DISTANCES, UINT32_MAX for the first lookup of a sector, and
+   returns the number of lookups. */
+static uint32_t
+print_reuse (uint32_t *distances)
+{
+  uint64_t *stack = xcalloc (header.event_cnt, sizeof *stack);
+  unsigned long hist[33];
+  unsigned long cold = 0, hits = 0;
+  uint32_t depth = 0, cnt = 0, i, d;
+
+  memset (hist, 0, sizeof hist);
+  for (i = 0; i < header.event_cnt; i++)
+    {
+      uint64_t key;
+
+      if (!is_lookup (&events[i]))
+        continue;
+      if (events[i].op == IOTRACE_HIT)
+        hits++;
+
+      /* STACK holds the sectors looked up, most recent first. */
+      key = lookup_key (&events[i]);
+      for (d = 0; d < depth && stack[d] != key; d++)
+        continue;
+      if (d == depth)
+        {
+          cold++;
+          distances[cnt++] = UINT32_MAX;
+          depth++;
+        }
+      else
+        {
+          hist[log2_bucket (d + 1)]++;
+          distances[cnt++] = d;
+        }
+      memmove (stack + 1, stack, d * sizeof *stack);
+      stack[0] = key;
+    }
+  free (stack);
+  if (cnt == 0)
+    {
+      printf ("No cache lookups to analyze.\n");
+      return 0;
+    }
+
+  printf ("Cache lookups: %"PRIu32", %.1f%% hits in the kernel, "
+          "%lu distinct sectors\n", cnt, 100.0 * hits / cnt, cold);
+  printf ("Reuse distances (distinct sectors since the last lookup, "
+          "plus one):\n");
+  print_histogram (hist, 33);
+  printf ("\n");
+  return cnt;
+}
+
+/* Replays the chosen cache lookups against a FIFO (if CLOCK is
+   false) or clock cache of SIZE sectors and returns its hit
+   rate. */
+static double
+replay (uint32_t size, bool clock)
+{
+  uint64_t *keys = xcalloc (size, sizeof *keys);
+  bool *used = xcalloc (size, sizeof *used);
+  uint32_t filled = 0, hand = 0, slot, i;
+  unsigned long lookups = 0, hits = 0;
+
+  for (i = 0; i < header.event_cnt; i++)
+    {
+      uint64_t key;
+
+      if (!is_lookup (&events[i]))
+        continue;
+      lookups++;
+      key = lookup_key (&events[i]);
+      for (slot = 0; slot < filled && keys[slot] != key; slot++)
+        continue;
+      if (slot < filled)
+        {
+          hits++;
+          used[slot] = true;
+          continue;
+        }
+
+      if (filled < size)
+        slot = filled++;
+      else
+        {
+          while (clock && used[hand])
+            {
+              used[hand] = false;
+              hand = (hand + 1) % size;
+            }
+          slot = hand;
+          hand = (hand + 1) % size;
+        }
+      keys[slot] = key;
+      used[slot] = true;
+    }
+  free (keys);
+  free (used);
+  return lookups > 0 ? 100.0 * hits / lookups : 0.0;
+}
+
+/* Prints the hit rates of LRU, FIFO and clock caches of each of
+   the SIZE_CNT sizes in SIZES on the chosen cache lookups, whose
+   CNT reuse distances are in DISTANCES. */
+static void
+print_replay (const uint32_t *distances, uint32_t cnt,
+              const uint32_t *sizes, int size_cnt)
+{
+  int s;
+
+  printf ("Replayed hit rates:\n  %8s %7s %7s %7s\n",
+          "sectors", "LRU", "FIFO", "clock");
+  for (s = 0; s < size_cnt; s++)
+    {
+      unsigned long lru_hits = 0;
+      uint32_t i;
+
+      /* An LRU cache hits exactly when the reuse distance is
+         less than its size. */
+      for (i = 0; i < cnt; i++)
+        if (distances[i] < sizes[s])
+          lru_hits++;
+      printf ("  %8"PRIu32" %6.1f%% %6.1f%% %6.1f%%\n", sizes[s],
+              100.0 * lru_hits / cnt, replay (sizes[s], false),
+              replay (sizes[s], true));
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t sizes[32] = { 16, 32, 64, 128, 256, 512 };
+  int size_cnt = 6;
+  int buckets = 32;
+  uint32_t *distances, cnt;
+  unsigned dev;
+  int i;
+
+  program_name = argv[0];
+  for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+      if (!strcmp (argv[i], "-b"))
+        {
+          buckets = atoi (argv[i + 1]);
+          if (buckets < 1)
+            fatal ("%s: not a valid number of rows", argv[i + 1]);
+        }
+      else if (!strcmp (argv[i], "-c"))
+        {
+          char *p = argv[i + 1];
+
+          for (size_cnt = 0; size_cnt < 32 && *p != '\0'; size_cnt++)
+            {
+              long size = strtol (p, &p, 10);
+              if (size < 1 || (*p != ',' && *p != '\0'))
+                fatal ("%s: not a valid list of sizes", argv[i + 1]);
+              sizes[size_cnt] = size;
+              if (*p == ',')
+                p++;
+            }
+        }
+      else if (!strcmp (argv[i], "-k"))
+        {
+          int kind;
+
+          lookup_kind = -1;
+          lookup_meta = !strcmp (argv[i + 1], "meta");
+          for (kind = 0; kind < IOTRACE_KIND_CNT; kind++)
+            if (!strcmp (argv[i + 1], kind_names[kind]))
+              lookup_kind = kind;
+          if (lookup_kind < 0 && !lookup_meta
+              && strcmp (argv[i + 1], "all"))
+            fatal ("%s: unknown kind", argv[i + 1]);
+        }
+      else
+        usage ();
+    }
+  if (i + 1 != argc)
+    usage ();
+
+  load (argv[i]);
+  print_summary ();
+  for (dev = 0; dev < header.dev_cnt && dev < IOTRACE_DEVS; dev++)
+    {
+      print_heat_map (dev, buckets);
+      print_sequentiality (dev);
+    }
+  distances = xcalloc (header.event_cnt, sizeof *distances);
+  cnt = print_reuse (distances);
+  if (cnt > 0)
+    print_replay (distances, cnt, sizes, size_cnt);
+  free (distances);
+  return EXIT_SUCCESS;
+}
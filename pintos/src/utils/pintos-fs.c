@@ -0,0 +1,960 @@
+/* Host-side tool for Pintos file system images.
+
+   Builds file system partition images straight from a host
+   directory tree, checks images for consistency, and reports
+   how their space is laid out.  The images are raw file system
+   partitions, suitable for "pintos --filesys=IMAGE".  The on-disk
+   format comes from filesys/ondisk.h, which the kernel uses too. */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "filesys/ondisk.h"
+
+#define SECTOR_SIZE 512
+#define PTRS_PER_SECTOR (SECTOR_SIZE / 4)
+
+static const char *program_name;
+
+/* The image, held entirely in memory. */
+static uint8_t *disk;
+static uint32_t disk_sectors;
+
+/* Sectors per file system block, and the derived sizes. */
+static uint32_t block_sectors = 1;
+#define BLOCK_BYTES (block_sectors * SECTOR_SIZE)
+#define PTRS_PER_BLOCK (block_sectors * PTRS_PER_SECTOR)
+
+/* Largest file the inode format can describe, in blocks. */
+#define MAX_FILE_BLOCKS (NUM_DIRECT_PTRS + PTRS_PER_BLOCK \
+                         + PTRS_PER_BLOCK * PTRS_PER_BLOCK)
+
+/* Free map: bit I set if sector I is in use. */
+static uint32_t *free_map;
+
+/* Extra references to each sector, shared by cloned files, which
+   the free map file stores after the bitmap.  Null for an image
+   made before files could be cloned. */
+static uint8_t *refs;
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "pintos-fs: builds and checks Pintos file system images\n"
+           "usage: %s mkfs [-b BYTES] IMAGE SIZE [DIR]\n"
+           "         creates IMAGE, a SIZE MB file system partition\n"
+           "         with BYTES-byte blocks (default 512), holding a\n"
+           "         copy of host directory DIR if given\n"
+           "       %s fsck IMAGE\n"
+           "         checks IMAGE for consistency\n"
+           "       %s stat IMAGE\n"
+           "         reports IMAGE's layout and fragmentation\n"
+           "Use an image with \"pintos --filesys=IMAGE\".\n",
+           program_name, program_name, program_name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+fatal (const char *format, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", program_name);
+  va_start (args, format);
+  vfprintf (stderr, format, args);
+  va_end (args);
+  putc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+static void *
+xcalloc (size_t n, size_t size)
+{
+  void *p = calloc (n, size);
+  if (p == NULL && n != 0 && size != 0)
+    fatal ("out of memory");
+  return p;
+}
+
+static uint8_t *
+sector_data (uint32_t sector)
+{
+  if (sector >= disk_sectors)
+    fatal ("sector %"PRIu32" is past the end of the image", sector);
+  return disk + (size_t) sector * SECTOR_SIZE;
+}
+
+static struct inode_disk *
+sector_inode (uint32_t sector)
+{
+  return (struct inode_disk *) sector_data (sector);
+}
+
+static uint32_t *
+sector_ptrs (uint32_t sector)
+{
+  return (uint32_t *) sector_data (sector);
+}
+
+static uint32_t
+div_round_up (uint32_t x, uint32_t step)
+{
+  return (x + step - 1) / step;
+}
+
+/* Free map bits. */
+
+static bool
+map_test (const uint32_t *map, uint32_t sector)
+{
+  return (map[sector / 32] >> (sector % 32)) & 1;
+}
+
+static void
+map_set (uint32_t *map, uint32_t sector)
+{
+  map[sector / 32] |= 1u << (sector % 32);
+}
+
+/* Returns the size of the free map's bitmap in bytes, as the
+   kernel's bitmap_file_size() computes it.  The reference counts
+   follow, one byte per sector. */
+static uint32_t
+free_map_bytes (void)
+{
+  return div_round_up (disk_sectors, 32) * 4;
+}
+
+/* Allocates the free map and reference counts, zeroed, as one
+   buffer laid out like the free map file, and returns it. */
+static uint8_t *
+alloc_free_map (void)
+{
+  uint8_t *map_file = xcalloc (free_map_bytes () + disk_sectors, 1);
+  free_map = (uint32_t *) map_file;
+  refs = map_file + free_map_bytes ();
+  return map_file;
+}
+
+static uint32_t lookup_sector (const struct inode_disk *, uint32_t idx);
+
+/* Image building. */
+
+/* Allocates CNT consecutive zeroed sectors, first fit like the
+   kernel, and returns the first. */
+static uint32_t
+alloc_sectors (uint32_t cnt)
+{
+  static uint32_t hint;
+  uint32_t sector, run = 0;
+
+  for (sector = hint; sector < disk_sectors; sector++)
+    if (map_test (free_map, sector))
+      run = 0;
+    else if (++run == cnt)
+      {
+        uint32_t first = sector + 1 - cnt;
+        for (sector = first; sector < first + cnt; sector++)
+          {
+            map_set (free_map, sector);
+            memset (sector_data (sector), 0, SECTOR_SIZE);
+          }
+        hint = first + cnt;
+        return first;
+      }
+  fatal ("image is full");
+  return 0;
+}
+
+/* Allocates a zeroed inode sector. */
+static uint32_t
+alloc_sector (void)
+{
+  return alloc_sectors (1);
+}
+
+/* Allocates a zeroed file system block. */
+static uint32_t
+alloc_block (void)
+{
+  return alloc_sectors (block_sectors);
+}
+
+/* Makes data block IDX of the inode in INODE_SECTOR point to
+   BLOCK, allocating index blocks as needed.  An index block's
+   sectors are consecutive in the image, so its pointers can be
+   indexed straight from its first sector. */
+static void
+install_block (uint32_t inode_sector, uint32_t idx, uint32_t block)
+{
+  struct inode_disk *inode = sector_inode (inode_sector);
+  uint32_t *ptrs;
+
+  if (idx < NUM_DIRECT_PTRS)
+    {
+      inode->direct[idx] = block;
+      return;
+    }
+  idx -= NUM_DIRECT_PTRS;
+  if (idx < PTRS_PER_BLOCK)
+    {
+      if (inode->single == 0)
+        inode->single = alloc_block ();
+      sector_ptrs (inode->single)[idx] = block;
+      return;
+    }
+  idx -= PTRS_PER_BLOCK;
+  if (inode->dbl == 0)
+    inode->dbl = alloc_block ();
+  ptrs = sector_ptrs (inode->dbl);
+  if (ptrs[idx / PTRS_PER_BLOCK] == 0)
+    {
+      uint32_t ind = alloc_block ();
+      /* alloc_block() never moves the image, but keep PTRS
+         honest by reloading it. */
+      ptrs = sector_ptrs (inode->dbl);
+      ptrs[idx / PTRS_PER_BLOCK] = ind;
+    }
+  sector_ptrs (ptrs[idx / PTRS_PER_BLOCK])[idx % PTRS_PER_BLOCK] = block;
+}
+
+/* Writes a SIZE-byte file or directory with contents DATA into a
+   new inode in INODE_SECTOR.  Returns INODE_SECTOR. */
+static uint32_t
+write_inode (uint32_t inode_sector, const void *data, uint32_t size,
+             bool is_dir)
+{
+  struct inode_disk *inode;
+  uint32_t i;
+
+  if (div_round_up (size, BLOCK_BYTES) > MAX_FILE_BLOCKS)
+    fatal ("%"PRIu32"-byte file is too large", size);
+  inode = sector_inode (inode_sector);
+  memset (inode, 0, SECTOR_SIZE);
+  inode->length = size;
+  inode->is_dir = is_dir;
+  inode->magic = INODE_MAGIC;
+
+  /* Small regular files keep their data in the inode sector. */
+  if (!is_dir && size <= INODE_INLINE_MAX)
+    {
+      inode->is_inline = 1;
+      memcpy (inode->data, data, size);
+      return inode_sector;
+    }
+
+  for (i = 0; i * BLOCK_BYTES < size; i++)
+    {
+      uint32_t chunk = size - i * BLOCK_BYTES;
+      uint32_t block = alloc_block ();
+
+      memcpy (sector_data (block), (const uint8_t *) data + i * BLOCK_BYTES,
+              chunk < BLOCK_BYTES ? chunk : BLOCK_BYTES);
+      install_block (inode_sector, i, block);
+    }
+  return inode_sector;
+}
+
+static int
+compare_names (const void *a_, const void *b_)
+{
+  const char *const *a = a_;
+  const char *const *b = b_;
+  return strcmp (*a, *b);
+}
+
+/* Reads host file PATH into a new buffer and stores its size in
+   *SIZE. */
+static uint8_t *
+read_host_file (const char *path, uint32_t *size)
+{
+  FILE *file = fopen (path, "rb");
+  uint8_t *data;
+  long length;
+
+  if (file == NULL)
+    fatal ("%s: open failed: %s", path, strerror (errno));
+  if (fseek (file, 0, SEEK_END) != 0 || (length = ftell (file)) < 0
+      || fseek (file, 0, SEEK_SET) != 0)
+    fatal ("%s: seek failed: %s", path, strerror (errno));
+  data = xcalloc (length + 1, 1);
+  if (fread (data, 1, length, file) != (size_t) length)
+    fatal ("%s: read failed", path);
+  fclose (file);
+  *size = length;
+  return data;
+}
+
+/* Copies host directory PATH into the directory whose inode goes
+   in INODE_SECTOR (0 to allocate one), whose parent's inode is in
+   PARENT.  The root directory, which PARENT is 0 for, gets no "."
+   and ".." entries and room for at least ROOT_DIR_ENTRIES.
+   Returns the directory's inode sector. */
+static uint32_t
+add_dir (const char *path, uint32_t inode_sector, uint32_t parent)
+{
+  bool is_root = parent == 0;
+  struct dir_entry *entries;
+  size_t name_cnt = 0, name_cap = 16, entry_cnt, slots, i;
+  char **names = xcalloc (name_cap, sizeof *names);
+  DIR *dir = path != NULL ? opendir (path) : NULL;
+  struct dirent *de;
+
+  if (path != NULL && dir == NULL)
+    fatal ("%s: opendir failed: %s", path, strerror (errno));
+  while (dir != NULL && (de = readdir (dir)) != NULL)
+    {
+      if (!strcmp (de->d_name, ".") || !strcmp (de->d_name, ".."))
+        continue;
+      if (strlen (de->d_name) > DIR_NAME_MAX)
+        fatal ("%s/%s: name longer than %d characters",
+               path, de->d_name, DIR_NAME_MAX);
+      if (name_cnt == name_cap)
+        {
+          name_cap *= 2;
+          names = realloc (names, name_cap * sizeof *names);
+          if (names == NULL)
+            fatal ("out of memory");
+        }
+      names[name_cnt++] = strdup (de->d_name);
+    }
+  if (dir != NULL)
+    closedir (dir);
+  qsort (names, name_cnt, sizeof *names, compare_names);
+
+  /* The directory's own inode sector comes first, so that its
+     children follow it on disk. */
+  if (inode_sector == 0)
+    inode_sector = alloc_sector ();
+
+  entry_cnt = name_cnt + (is_root ? 0 : 2);
+  slots = entry_cnt;
+  if (is_root && slots < ROOT_DIR_ENTRIES)
+    slots = ROOT_DIR_ENTRIES;
+  entries = xcalloc (slots, sizeof *entries);
+  entry_cnt = 0;
+  if (!is_root)
+    {
+      entries[0].inode_sector = inode_sector;
+      strcpy (entries[0].name, ".");
+      entries[0].in_use = true;
+      entries[1].inode_sector = parent;
+      strcpy (entries[1].name, "..");
+      entries[1].in_use = true;
+      entry_cnt = 2;
+    }
+
+  for (i = 0; i < name_cnt; i++)
+    {
+      struct dir_entry *e = &entries[entry_cnt++];
+      char *child = xcalloc (strlen (path) + strlen (names[i]) + 2, 1);
+      struct stat st;
+
+      sprintf (child, "%s/%s", path, names[i]);
+      if (stat (child, &st) != 0)
+        fatal ("%s: stat failed: %s", child, strerror (errno));
+      strcpy (e->name, names[i]);
+      e->in_use = true;
+      if (S_ISDIR (st.st_mode))
+        e->inode_sector = add_dir (child, 0, inode_sector);
+      else if (S_ISREG (st.st_mode))
+        {
+          uint32_t size;
+          uint8_t *data = read_host_file (child, &size);
+          e->inode_sector = write_inode (alloc_sector (), data, size, false);
+          free (data);
+        }
+      else
+        fatal ("%s: not a regular file or directory", child);
+      free (child);
+      free (names[i]);
+    }
+  free (names);
+
+  write_inode (inode_sector, entries, slots * sizeof *entries, true);
+  free (entries);
+  return inode_sector;
+}
+
+/* Formats the in-memory image as the kernel's do_format() would,
+   copying host directory SRC into it if SRC is non-null. */
+static void
+mkfs (const char *src)
+{
+  struct journal_block *header;
+  struct inode_disk *map_inode;
+  uint32_t map_bytes = free_map_bytes ();
+  uint8_t *map_file;
+  uint32_t i;
+
+  if (disk_sectors < JOURNAL_SECTOR + JOURNAL_SECTORS + 1)
+    fatal ("image must be at least %d sectors",
+           JOURNAL_SECTOR + JOURNAL_SECTORS + 1);
+  map_file = alloc_free_map ();
+  map_set (free_map, FREE_MAP_SECTOR);
+  map_set (free_map, ROOT_DIR_SECTOR);
+  for (i = 0; i < JOURNAL_SECTORS; i++)
+    map_set (free_map, JOURNAL_SECTOR + i);
+
+  /* An empty journal. */
+  header = (struct journal_block *) sector_data (JOURNAL_SECTOR);
+  header->magic = JOURNAL_MAGIC;
+  header->seq = 1;
+  header->block_sectors = block_sectors;
+
+  /* Lay out the free map file first, so that its data sectors sit
+     right after the journal as on a kernel-formatted disk. */
+  write_inode (FREE_MAP_SECTOR, map_file, map_bytes + disk_sectors, false);
+
+  add_dir (src, ROOT_DIR_SECTOR, 0);
+
+  /* Now that every sector is allocated, store the final free map
+     into the sectors laid out for it.  The reference counts stay
+     zero. */
+  map_inode = sector_inode (FREE_MAP_SECTOR);
+  if (map_inode->is_inline)
+    memcpy (map_inode->data, free_map, map_bytes);
+  else
+    for (i = 0; i < map_bytes; i += SECTOR_SIZE)
+      {
+        uint32_t chunk = map_bytes - i;
+        memcpy (sector_data (lookup_sector (map_inode, i / SECTOR_SIZE)),
+                (uint8_t *) free_map + i,
+                chunk < SECTOR_SIZE ? chunk : SECTOR_SIZE);
+      }
+}
+
+/* Image checking. */
+
+/* What a walk over the image found. */
+struct report
+  {
+    unsigned errors;                    /* Inconsistencies. */
+    unsigned warnings;                  /* Harmless oddities. */
+    bool quiet;                         /* Don't print problems. */
+    uint16_t *reached;                  /* Times each sector was reached. */
+
+    unsigned files, dirs, inline_files;
+    uint64_t data_bytes;
+    uint32_t data_sectors, index_sectors;
+    unsigned fragmented_files;          /* Files in more than one extent. */
+    uint64_t extents;                   /* Extents over all files. */
+    unsigned max_extents;               /* Extents of worst file. */
+    char worst_file[256];               /* Name of worst file. */
+  };
+
+static void
+problem (struct report *r, bool error, const char *format, ...)
+{
+  va_list args;
+
+  if (error)
+    r->errors++;
+  else
+    r->warnings++;
+  if (r->quiet)
+    return;
+  printf ("%s: ", error ? "error" : "warning");
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+  putchar ('\n');
+}
+
+/* Marks SECTOR, used by PATH for WHAT, as reached.  Returns false
+   if it is out of range or was already reached more times than its
+   references allow.  Only data sectors may be shared. */
+static bool
+reach (struct report *r, uint32_t sector, const char *path, const char *what)
+{
+  uint32_t shares;
+
+  if (sector >= disk_sectors)
+    {
+      problem (r, true, "%s: %s sector %"PRIu32" is past the end of the image",
+               path, what, sector);
+      return false;
+    }
+  shares = refs != NULL && !strcmp (what, "data") ? refs[sector] : 0;
+  if (r->reached[sector] > shares)
+    {
+      problem (r, true, "%s: %s sector %"PRIu32" is already in use",
+               path, what, sector);
+      return false;
+    }
+  r->reached[sector]++;
+  return true;
+}
+
+/* Returns true if the block starting at SECTOR lies within the
+   image. */
+static bool
+block_in_image (uint32_t sector)
+{
+  return sector < disk_sectors && disk_sectors - sector >= block_sectors;
+}
+
+/* Returns the first sector of data block IDX of INODE, or 0 if it
+   has none. */
+static uint32_t
+lookup_block (const struct inode_disk *inode, uint32_t idx)
+{
+  uint32_t ind;
+
+  if (idx < NUM_DIRECT_PTRS)
+    return inode->direct[idx];
+  idx -= NUM_DIRECT_PTRS;
+  if (idx < PTRS_PER_BLOCK)
+    return inode->single != 0 && block_in_image (inode->single)
+           ? sector_ptrs (inode->single)[idx] : 0;
+  idx -= PTRS_PER_BLOCK;
+  if (inode->dbl == 0 || !block_in_image (inode->dbl))
+    return 0;
+  ind = sector_ptrs (inode->dbl)[idx / PTRS_PER_BLOCK];
+  return ind != 0 && block_in_image (ind)
+         ? sector_ptrs (ind)[idx % PTRS_PER_BLOCK] : 0;
+}
+
+/* Returns data sector IDX of INODE, or 0 if it has none. */
+static uint32_t
+lookup_sector (const struct inode_disk *inode, uint32_t idx)
+{
+  uint32_t block = lookup_block (inode, idx / block_sectors);
+  return block != 0 ? block + idx % block_sectors : 0;
+}
+
+/* Marks the sectors of the block starting at SECTOR, used by PATH
+   for WHAT, as reached.  Returns false if any of them is out of
+   range or was already reached. */
+static bool
+reach_block (struct report *r, uint32_t sector, const char *path,
+             const char *what)
+{
+  bool ok = true;
+  uint32_t i;
+
+  for (i = 0; i < block_sectors; i++)
+    if (!reach (r, sector + i, path, what))
+      ok = false;
+  return ok;
+}
+
+/* Marks the index block SECTOR of PATH and, if DEPTH is 2, the
+   index blocks it points to. */
+static void
+reach_index (struct report *r, uint32_t sector, int depth, const char *path)
+{
+  uint32_t i;
+
+  if (sector == 0 || !reach_block (r, sector, path, "index"))
+    return;
+  r->index_sectors += block_sectors;
+  if (depth == 2)
+    for (i = 0; i < PTRS_PER_BLOCK; i++)
+      reach_index (r, sector_ptrs (sector)[i], 1, path);
+}
+
+static void check_dir (struct report *, uint32_t sector, uint32_t parent,
+                       const char *path);
+
+/* Checks the inode in SECTOR, reached as PATH, and everything
+   below it.  PARENT is the inode sector of its directory. */
+static void
+check_inode (struct report *r, uint32_t sector, uint32_t parent,
+             const char *path)
+{
+  struct inode_disk *inode;
+  uint32_t blocks, i, prev = 0, extents = 0;
+
+  if (!reach (r, sector, path, "inode"))
+    return;
+  inode = sector_inode (sector);
+  if (inode->magic != INODE_MAGIC)
+    {
+      problem (r, true, "%s: bad inode magic in sector %"PRIu32,
+               path, sector);
+      return;
+    }
+  if (inode->length < 0)
+    {
+      problem (r, true, "%s: negative length", path);
+      return;
+    }
+  blocks = div_round_up (inode->length, BLOCK_BYTES);
+
+  if (inode->is_inline)
+    {
+      if (inode->is_dir)
+        problem (r, true, "%s: directory is inline", path);
+      if (inode->length > INODE_INLINE_MAX)
+        problem (r, true, "%s: inline file is %"PRId32" bytes long",
+                 path, inode->length);
+      for (i = 0; i < NUM_DIRECT_PTRS; i++)
+        if (inode->direct[i] != 0)
+          problem (r, true, "%s: inline file has data sectors", path);
+      r->inline_files++;
+      blocks = 0;
+    }
+  else if (blocks > MAX_FILE_BLOCKS)
+    {
+      problem (r, true, "%s: length %"PRId32" is too large",
+               path, inode->length);
+      return;
+    }
+
+  /* Index blocks, then data blocks in file order. */
+  if (!inode->is_inline)
+    {
+      reach_index (r, inode->single, 1, path);
+      reach_index (r, inode->dbl, 2, path);
+    }
+  for (i = 0; i < blocks; i++)
+    {
+      uint32_t data = lookup_block (inode, i);
+      if (data == 0)
+        {
+          problem (r, true, "%s: no block for bytes %"PRIu32" onward",
+                   path, i * BLOCK_BYTES);
+          break;
+        }
+      if (!reach_block (r, data, path, "data"))
+        continue;
+      if (extents == 0 || data != prev + block_sectors)
+        extents++;
+      prev = data;
+      r->data_sectors += block_sectors;
+    }
+  r->data_bytes += inode->length;
+  r->extents += extents;
+  if (extents > 1)
+    r->fragmented_files++;
+  if (extents > r->max_extents)
+    {
+      r->max_extents = extents;
+      snprintf (r->worst_file, sizeof r->worst_file, "%s", path);
+    }
+
+  if (inode->is_dir)
+    {
+      r->dirs++;
+      check_dir (r, sector, parent, path);
+    }
+  else
+    r->files++;
+}
+
+/* Checks the entries of the directory in SECTOR, reached as PATH,
+   whose parent directory's inode is in PARENT. */
+static void
+check_dir (struct report *r, uint32_t sector, uint32_t parent,
+           const char *path)
+{
+  const struct inode_disk *inode = sector_inode (sector);
+  size_t cnt = inode->length / sizeof (struct dir_entry);
+  struct dir_entry *entries = xcalloc (cnt + 1, sizeof *entries);
+  bool is_root = sector == ROOT_DIR_SECTOR;
+  size_t i, j;
+
+  if (inode->length % sizeof (struct dir_entry) != 0)
+    problem (r, false, "%s: length is not a whole number of entries", path);
+  for (i = 0; i < cnt * sizeof *entries; i += SECTOR_SIZE)
+    {
+      uint32_t data = lookup_sector (inode, i / SECTOR_SIZE);
+      size_t chunk = cnt * sizeof *entries - i;
+      if (data == 0 || data >= disk_sectors)
+        {
+          free (entries);
+          return;
+        }
+      memcpy ((uint8_t *) entries + i, sector_data (data),
+              chunk < SECTOR_SIZE ? chunk : SECTOR_SIZE);
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct dir_entry *e = &entries[i];
+      char child[1024];
+
+      if (!e->in_use)
+        continue;
+      if (memchr (e->name, '\0', sizeof e->name) == NULL || e->name[0] == '\0')
+        {
+          problem (r, true, "%s: entry %zu has a bad name", path, i);
+          continue;
+        }
+      for (j = 0; j < i; j++)
+        if (entries[j].in_use && !strcmp (entries[j].name, e->name))
+          problem (r, true, "%s: \"%s\" appears twice", path, e->name);
+
+      if (!strcmp (e->name, "."))
+        {
+          if (is_root || e->inode_sector != sector)
+            problem (r, true, "%s: bad \".\" entry", path);
+          continue;
+        }
+      if (!strcmp (e->name, ".."))
+        {
+          if (is_root || e->inode_sector != parent)
+            problem (r, true, "%s: bad \"..\" entry", path);
+          continue;
+        }
+      snprintf (child, sizeof child, "%s%s%s",
+                path, is_root ? "" : "/", e->name);
+      check_inode (r, e->inode_sector, sector, child);
+    }
+  free (entries);
+}
+
+/* Walks the whole image, filling in R.  Loads the free map into
+   free_map on the way. */
+static void
+walk (struct report *r)
+{
+  struct journal_block *header, *desc;
+  uint32_t map_bytes = free_map_bytes ();
+  struct inode_disk *map_inode;
+  struct report saved;
+  uint8_t *map_file;
+  uint32_t i;
+
+  r->reached = xcalloc (disk_sectors, sizeof *r->reached);
+  map_file = alloc_free_map ();
+  if (disk_sectors < JOURNAL_SECTOR + JOURNAL_SECTORS + 1)
+    fatal ("image is only %"PRIu32" sectors long", disk_sectors);
+
+  /* Journal. */
+  header = (struct journal_block *) sector_data (JOURNAL_SECTOR);
+  desc = (struct journal_block *) sector_data (JOURNAL_SECTOR + 1);
+  if (header->magic != JOURNAL_MAGIC)
+    problem (r, true, "journal header has bad magic");
+  else
+    {
+      if (header->block_sectors > FS_BLOCK_SECTORS_MAX
+          || (header->block_sectors & (header->block_sectors - 1)) != 0)
+        problem (r, true, "journal header has bad block size %"PRIu32,
+                 header->block_sectors);
+      else if (header->block_sectors != 0)
+        block_sectors = header->block_sectors;
+      if (desc->magic == JOURNAL_DESC_MAGIC && desc->seq == header->seq)
+        problem (r, false, "journal holds committed transactions, which "
+                 "the kernel replays at the next mount");
+    }
+  for (i = 0; i < JOURNAL_SECTORS; i++)
+    reach (r, JOURNAL_SECTOR + i, "journal", "log");
+
+  /* Free map, then the tree. */
+  /* The free map file is checked like any other, but left out of
+     the statistics. */
+  /* The free map file is read first, so that its reference counts
+     apply to the walk. */
+  map_inode = sector_inode (FREE_MAP_SECTOR);
+  if (map_inode->length == (int32_t) map_bytes)
+    refs = NULL;
+  else if (map_inode->magic == INODE_MAGIC
+           && map_inode->length != (int32_t) (map_bytes + disk_sectors))
+    {
+      problem (r, true, "free map is %"PRId32" bytes, expected %"PRIu32
+               " or %"PRIu32, map_inode->length, map_bytes,
+               map_bytes + disk_sectors);
+      refs = NULL;
+    }
+  if (map_inode->magic == INODE_MAGIC && map_inode->length >= 0
+      && (uint32_t) map_inode->length <= map_bytes + disk_sectors)
+    {
+      uint32_t length = map_inode->length;
+      if (map_inode->is_inline)
+        memcpy (map_file, map_inode->data,
+                length < INODE_INLINE_MAX ? length : INODE_INLINE_MAX);
+      else
+        for (i = 0; i < length; i += SECTOR_SIZE)
+          {
+            uint32_t data = lookup_sector (map_inode, i / SECTOR_SIZE);
+            uint32_t chunk = length - i;
+            if (data != 0 && data < disk_sectors)
+              memcpy (map_file + i, sector_data (data),
+                      chunk < SECTOR_SIZE ? chunk : SECTOR_SIZE);
+          }
+    }
+  saved = *r;
+  check_inode (r, FREE_MAP_SECTOR, FREE_MAP_SECTOR, "free map");
+  saved.errors = r->errors;
+  saved.warnings = r->warnings;
+  *r = saved;
+
+  check_inode (r, ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, "/");
+  if (!sector_inode (ROOT_DIR_SECTOR)->is_dir)
+    problem (r, true, "root is not a directory");
+}
+
+/* Reports the differences between the free map and the sectors
+   the walk reached. */
+static void
+check_free_map (struct report *r)
+{
+  uint32_t sector, leaked = 0, lost = 0, first_lost = 0, stale = 0;
+
+  for (sector = 0; sector < disk_sectors; sector++)
+    {
+      bool used = map_test (free_map, sector);
+      bool reached = r->reached[sector] > 0;
+      if (reached && !used && lost++ == 0)
+        first_lost = sector;
+      else if (used && !reached)
+        leaked++;
+      if (refs != NULL && reached && r->reached[sector] - 1 < refs[sector])
+        stale++;
+    }
+  if (lost > 0)
+    problem (r, true, "%"PRIu32" sectors in use are marked free, "
+             "starting with sector %"PRIu32, lost, first_lost);
+  if (leaked > 0)
+    problem (r, false, "%"PRIu32" sectors are marked in use but unreachable",
+             leaked);
+  if (stale > 0)
+    problem (r, false, "%"PRIu32" shared sectors have more references "
+             "than files using them", stale);
+}
+
+static int
+do_fsck (void)
+{
+  struct report r;
+
+  memset (&r, 0, sizeof r);
+  walk (&r);
+  check_free_map (&r);
+  printf ("%u files, %u directories, %u errors, %u warnings\n",
+          r.files, r.dirs, r.errors, r.warnings);
+  return r.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int
+do_stat (void)
+{
+  struct report r;
+  uint32_t sector, used = 0, free_runs = 0, run = 0, longest = 0;
+
+  memset (&r, 0, sizeof r);
+  r.quiet = true;
+  walk (&r);
+
+  for (sector = 0; sector < disk_sectors; sector++)
+    if (map_test (free_map, sector))
+      {
+        used++;
+        run = 0;
+      }
+    else
+      {
+        if (run++ == 0)
+          free_runs++;
+        if (run > longest)
+          longest = run;
+      }
+
+  printf ("sectors: %"PRIu32" total, %"PRIu32" used, %"PRIu32" free\n",
+          disk_sectors, used, disk_sectors - used);
+  printf ("layout: %d journal, %"PRIu32" index, %"PRIu32" data\n",
+          JOURNAL_SECTORS, r.index_sectors, r.data_sectors);
+  printf ("files: %u (%u inline), directories: %u, bytes: %"PRIu64"\n",
+          r.files, r.inline_files, r.dirs, r.data_bytes);
+  printf ("extents: %"PRIu64", fragmented files: %u, "
+          "average extents per file: %.2f\n",
+          r.extents, r.fragmented_files,
+          r.files + r.dirs > 0 ? (double) r.extents / (r.files + r.dirs) : 0.0);
+  if (r.max_extents > 1)
+    printf ("most fragmented: %s (%u extents)\n", r.worst_file, r.max_extents);
+  printf ("free extents: %"PRIu32", longest: %"PRIu32" sectors\n",
+          free_runs, longest);
+  if (r.errors > 0)
+    printf ("image has %u errors; run fsck for details\n", r.errors);
+  return EXIT_SUCCESS;
+}
+
+static void
+load_image (const char *name)
+{
+  FILE *file = fopen (name, "rb");
+  long size;
+
+  if (file == NULL)
+    fatal ("%s: open failed: %s", name, strerror (errno));
+  if (fseek (file, 0, SEEK_END) != 0 || (size = ftell (file)) < 0
+      || fseek (file, 0, SEEK_SET) != 0)
+    fatal ("%s: seek failed: %s", name, strerror (errno));
+  disk_sectors = size / SECTOR_SIZE;
+  disk = xcalloc (disk_sectors, SECTOR_SIZE);
+  if (fread (disk, SECTOR_SIZE, disk_sectors, file) != disk_sectors)
+    fatal ("%s: read failed", name);
+  fclose (file);
+}
+
+static void
+save_image (const char *name)
+{
+  FILE *file = fopen (name, "wb");
+
+  if (file == NULL)
+    fatal ("%s: create failed: %s", name, strerror (errno));
+  if (fwrite (disk, SECTOR_SIZE, disk_sectors, file) != disk_sectors
+      || fclose (file) != 0)
+    fatal ("%s: write failed", name);
+}
+
+int
+main (int argc, char *argv[])
+{
+  program_name = argv[0];
+  if (argc < 3)
+    usage ();
+
+  if (!strcmp (argv[1], "mkfs"))
+    {
+      double mb;
+
+      argv++;
+      argc--;
+      if (argc >= 3 && !strcmp (argv[1], "-b"))
+        {
+          long bytes = strtol (argv[2], NULL, 10);
+          block_sectors = bytes / SECTOR_SIZE;
+          if (bytes % SECTOR_SIZE != 0 || block_sectors < 1
+              || block_sectors > FS_BLOCK_SECTORS_MAX
+              || (block_sectors & (block_sectors - 1)) != 0)
+            fatal ("%s: block size must be a power of 2 from %d to %d",
+                   argv[2], SECTOR_SIZE, FS_BLOCK_SECTORS_MAX * SECTOR_SIZE);
+          argv += 2;
+          argc -= 2;
+        }
+      if (argc != 3 && argc != 4)
+        usage ();
+      mb = strtod (argv[2], NULL);
+      if (mb <= 0)
+        fatal ("%s: not a valid size in MB", argv[2]);
+      disk_sectors = mb * 1024 * 1024 / SECTOR_SIZE;
+      disk = xcalloc (disk_sectors, SECTOR_SIZE);
+      mkfs (argc == 4 ? argv[3] : NULL);
+      save_image (argv[1]);
+      return EXIT_SUCCESS;
+    }
+  else if (!strcmp (argv[1], "fsck") && argc == 3)
+    {
+      load_image (argv[2]);
+      return do_fsck ();
+    }
+  else if (!strcmp (argv[1], "stat") && argc == 3)
+    {
+      load_image (argv[2]);
+      return do_stat ();
+    }
+  usage ();
+  return EXIT_FAILURE;
+}